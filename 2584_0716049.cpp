@@ -11,21 +11,25 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <memory>
+#include <thread>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistic.h"
+#include "recorder.h"
+#include "runner.h"
+#include "batch.h"
+#include "driver.h"
+#include "trainer.h"
 
 int main(int argc, const char* argv[]) {
-	std::cout << "2048-Demo: ";
-	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
-	std::cout << std::endl << std::endl;
-
-	size_t total = 1000, block = 0, limit = 0;
-	std::string play_args, evil_args;
-	std::string load, save;
-	bool summary = false;
+	size_t total = 1000, block = 0, limit = 0, threads = 0, lockstep = 0;
+	size_t rounds = 0, eval = 1000, checkpoint = 1;
+	std::string play_type, play_args, evil_args;
+	std::string load, save, log, convert, latency, drive;
+	bool summary = false, sync = false, check = false;
 	for (int i = 1; i < argc; i++) {
 		std::string para(argv[i]);
 		if (para.find("--total=") == 0) {
@@ -36,52 +40,118 @@ int main(int argc, const char* argv[]) {
 			limit = std::stoull(para.substr(para.find("=") + 1));
 		} else if (para.find("--play=") == 0) {
 			play_args = para.substr(para.find("=") + 1);
+		} else if (para.find("--player=") == 0) {
+			play_type = para.substr(para.find("=") + 1);
 		} else if (para.find("--evil=") == 0) {
 			evil_args = para.substr(para.find("=") + 1);
 		} else if (para.find("--load=") == 0) {
 			load = para.substr(para.find("=") + 1);
 		} else if (para.find("--save=") == 0) {
 			save = para.substr(para.find("=") + 1);
+		} else if (para.find("--log=") == 0) {
+			log = para.substr(para.find("=") + 1);
+		} else if (para.find("--fsync") == 0) {
+			sync = true;
+		} else if (para.find("--convert=") == 0) {
+			convert = para.substr(para.find("=") + 1);
+		} else if (para.find("--threads=") == 0) {
+			threads = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--rounds=") == 0) {
+			rounds = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--eval=") == 0) {
+			eval = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--checkpoint=") == 0) {
+			checkpoint = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--driver=") == 0) {
+			drive = para.substr(para.find("=") + 1);
+		} else if (para.find("--batch=") == 0) {
+			lockstep = std::stoull(para.substr(para.find("=") + 1));
+		} else if (para.find("--check") == 0) {
+			check = true;
+		} else if (para.find("--latency=") == 0) {
+			latency = para.substr(para.find("=") + 1);
 		} else if (para.find("--summary") == 0) {
 			summary = true;
 		}
 	}
 
+	if (play_type.size() && play_type != "weight" && play_type != "mcts") {
+		std::cerr << "unknown player '" << play_type << "' (expected weight or mcts)" << std::endl;
+		return -1;
+	}
+	if (drive.size() && drive != "virtual" && drive != "static") {
+		std::cerr << "unknown driver '" << drive << "' (expected virtual or static)" << std::endl;
+		return -1;
+	}
+
+	if (convert.size()) {
+		std::ofstream out;
+		if (save.size()) out.open(save, std::ios::out | std::ios::trunc);
+		long count = recorder::convert(convert, save.size() ? out : std::cout);
+		if (count < 0) std::cerr << convert << " is not a binary episode log" << std::endl;
+		return count < 0 ? -1 : 0;
+	}
+
+	// the banner is not printed when converting, since the converted records may go to stdout
+	std::cout << "2048-Demo: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
+	std::cout << std::endl << std::endl;
+
 	statistic stat(total, block, limit);
 
 	if (load.size()) {
-		std::ifstream in(load, std::ios::in);
-		in >> stat;
-		in.close();
+		long invalid = stat.load(load, threads ? threads : std::thread::hardware_concurrency(), check);
+		if (check) std::cout << stat.size() << " records loaded, " << std::max(invalid, 0l) << " invalid" << std::endl << std::endl;
 		summary |= stat.is_finished();
 	}
 
-	weight_agent play(play_args);
+	std::unique_ptr<weight_agent> player(runner::create(play_type, play_args));
+	weight_agent& play = *player;
 	rndenv evil(evil_args);
+	play.check();
+	evil.check();
+
+	if (rounds) {
+		trainer::schedule plan = { rounds, total, block, limit, eval, checkpoint, save };
+		if (play_type == "mcts") trainer(plan).run(static_cast<mcts_agent&>(play), evil_args);
+		else trainer(plan).run(play, evil_args);
+		return 0;
+	}
+
+	std::unique_ptr<recorder> logger;
+	if (log.size()) logger.reset(new recorder(log, sync));
 
-	while (!stat.is_finished()) {
-		play.open_episode("~:" + evil.name());
-		evil.open_episode(play.name() + ":~");
-
-		stat.open_episode(play.name() + ":" + evil.name());
-		episode& game = stat.back();
-		while (true) {
-			agent& who = game.take_turns(play, evil);
-			action move = who.take_action(game.state());
-			if (game.apply_action(move) != true) break;
-			if (who.check_for_win(game.state())) break;
+	if ((threads || lockstep) && !stat.is_finished()) {
+		if (play.learning_rate() != 0) {
+			std::cerr << (lockstep ? "--batch" : "--threads") << " cannot be used with training (alpha=" << play.learning_rate() << ")" << std::endl;
+			return -1;
 		}
-		agent& win = game.last_turns(play, evil);
-		stat.close_episode(win.name());
+		if (lockstep && play_type == "mcts") {
+			std::cerr << "--batch cannot be used with --player=mcts" << std::endl;
+			return -1;
+		}
+		if (lockstep) batch(lockstep).run(stat, play, evil_args, logger.get());
+		else runner(play_type, play_args, evil_args, threads).run(stat, play, evil, logger.get());
+	}
 
-		play.close_episode(win.name());
-		evil.close_episode(win.name());
+	if (drive == "virtual") {
+		play_episodes<agent, agent>(stat, play, evil, logger.get());
+	} else if (play_type == "mcts") {
+		play_episodes(stat, static_cast<mcts_agent&>(play), evil, logger.get());
+	} else {
+		play_episodes(stat, play, evil, logger.get());
 	}
 
 	if (summary) {
 		stat.summary();
 	}
 
+	if (latency.size()) {
+		std::ofstream out(latency, std::ios::out | std::ios::trunc);
+		stat.latency(out);
+		out.close();
+	}
+
 	if (save.size()) {
 		std::ofstream out(save, std::ios::out | std::ios::trunc);
 		out << stat;
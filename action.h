@@ -9,38 +9,25 @@
 
 #pragma once
 #include <algorithm>
-#include <unordered_map>
 #include <string>
 #include "board.h"
 
+/**
+ * an action is a plain 32-bit code, with its type in the highest byte
+ * apply, print, and parse are dispatched by the type with a switch, so that no virtual call is involved
+ */
 class action {
 public:
 	action(unsigned code = -1u) : code(code) {}
 	action(const action& a) : code(a.code) {}
-	virtual ~action() {}
 
 	class slide; // create a sliding action with board opcode
 	class place; // create a placing action with position and tile
 
 public:
-	virtual board::reward apply(board& b) const {
-		auto proto = entries().find(type());
-		if (proto != entries().end()) return proto->second->reinterpret(this).apply(b);
-		return -1;
-	}
-	virtual std::ostream& operator >>(std::ostream& out) const {
-		auto proto = entries().find(type());
-		if (proto != entries().end()) return proto->second->reinterpret(this) >> out;
-		return out << "??";
-	}
-	virtual std::istream& operator <<(std::istream& in) {
-		auto state = in.rdstate();
-		for (auto proto = entries().begin(); proto != entries().end(); proto++) {
-			if (proto->second->reinterpret(this) << in) return in;
-			in.clear(state);
-		}
-		return in.ignore(2);
-	}
+	board::reward apply(board& b) const;
+	std::ostream& operator >>(std::ostream& out) const;
+	std::istream& operator <<(std::istream& in);
 
 public:
 	operator unsigned() const { return code; }
@@ -52,10 +39,6 @@ public:
 protected:
 	static constexpr unsigned type_flag(unsigned v) { return v << 24; }
 
-	typedef std::unordered_map<unsigned, action*> prototype;
-	static prototype& entries() { static prototype m; return m; }
-	virtual action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) action(*a); }
-
 	unsigned code;
 };
 
@@ -85,9 +68,6 @@ public:
 		in.setstate(std::ios::failbit);
 		return in;
 	}
-protected:
-	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) slide(*a); }
-	static __attribute__((constructor)) void init() { entries()[type_flag('s')] = new slide; }
 };
 
 class action::place : public action {
@@ -120,7 +100,37 @@ public:
 		in.setstate(std::ios::failbit);
 		return in;
 	}
-protected:
-	action& reinterpret(const action* a) const { return *new (const_cast<action*>(a)) place(*a); }
-	static __attribute__((constructor)) void init() { entries()[type_flag('p')] = new place; }
 };
+
+inline board::reward action::apply(board& b) const {
+	switch (type()) {
+	case slide::type: return slide(*this).apply(b);
+	case place::type: return place(*this).apply(b);
+	default: return -1;
+	}
+}
+
+inline std::ostream& action::operator >>(std::ostream& out) const {
+	switch (type()) {
+	case slide::type: return slide(*this) >> out;
+	case place::type: return place(*this) >> out;
+	default: return out << "??";
+	}
+}
+
+inline std::istream& action::operator <<(std::istream& in) {
+	auto state = in.rdstate();
+	slide s;
+	if (s << in) {
+		operator =(s);
+		return in;
+	}
+	in.clear(state);
+	place p;
+	if (p << in) {
+		operator =(p);
+		return in;
+	}
+	in.clear(state);
+	return in.ignore(2);
+}
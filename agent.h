@@ -12,12 +12,24 @@
 #include <random>
 #include <sstream>
 #include <map>
+#include <set>
+#include <limits>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdio>
 #include <type_traits>
 #include <algorithm>
 #include "board.h"
 #include "action.h"
+#include "symbol.h"
 #include "weight.h"
+#include "random.h"
+#include "schedule.h"
 #include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
 
 class agent {
 public:
@@ -28,28 +40,122 @@ public:
 			std::string value = pair.substr(pair.find('=') + 1);
 			meta[key] = { value };
 		}
+		std::string name, role;
+		option("name", name);
+		option("role", role);
+		agent_name = name;
+		agent_role = role;
 	}
 	virtual ~agent() {}
 	virtual void open_episode(const std::string& flag = "") {}
 	virtual void close_episode(const std::string& flag = "") {}
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
+	/**
+	 * prepare to play the given episode, so that agents with randomness can play it regardless of the episodes before
+	 */
+	virtual void reseed(size_t episode) {}
 
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
-	virtual void notify(const std::string& msg) { meta[msg.substr(0, msg.find('='))] = { msg.substr(msg.find('=') + 1) }; }
-	virtual std::string name() const { return property("name"); }
-	virtual std::string role() const { return property("role"); }
+	virtual void notify(const std::string& msg) {
+		std::string key = msg.substr(0, msg.find('='));
+		meta[key] = { msg.substr(msg.find('=') + 1) };
+		if (key == "name") agent_name = property("name");
+		if (key == "role") agent_role = property("role");
+	}
+	/**
+	 * the name and the role are interned when they are set, so they are returned without any lookup or copy
+	 */
+	virtual const std::string& name() const { return agent_name; }
+	virtual const std::string& role() const { return agent_role; }
+
+	/**
+	 * check that all the given options are declared by the agent, which should be called once it is constructed
+	 * an unknown option is reported and terminates the program
+	 */
+	void check() const {
+		for (auto& kv : meta) {
+			if (known.count(kv.first)) continue;
+			std::cerr << name() << ": unknown option '" << kv.first << "'" << std::endl;
+			std::exit(-1);
+		}
+	}
 
 protected:
+	/**
+	 * declare an option of the agent, and parse its value into the typed field if it is given,
+	 * so that the agent reads the option as a plain field afterward
+	 * an invalid value is reported and terminates the program
+	 * return whether the option is given
+	 */
+	template<typename type>
+	bool option(const std::string& key, type& field) {
+		known.insert(key);
+		auto it = meta.find(key);
+		if (it == meta.end()) return false;
+		if (!parse(it->second.value, field)) invalid(key);
+		return true;
+	}
+	/**
+	 * declare a flag, which is set by the bare key (e.g., 'tc'), or by 'key=1' or 'key=0'
+	 */
+	bool option(const std::string& key, bool& field) {
+		known.insert(key);
+		auto it = meta.find(key);
+		if (it == meta.end()) return false;
+		const std::string& v = it->second.value;
+		if (v != key && v != "1" && v != "0" && v != "true" && v != "false") invalid(key);
+		field = (v != "0" && v != "false");
+		return true;
+	}
+	void invalid(const std::string& key) const {
+		std::cerr << name() << ": invalid value of option '" << key << "': " << property(key) << std::endl;
+		std::exit(-1);
+	}
+
+	static bool parse(const std::string& s, std::string& v) {
+		v = s;
+		return true;
+	}
+	template<typename integer>
+	static typename std::enable_if<std::is_integral<integer>::value, bool>::type parse(const std::string& s, integer& v) {
+		size_t pos = 0;
+		try {
+			if (std::is_signed<integer>::value) {
+				long long x = std::stoll(s, &pos);
+				if (x < std::numeric_limits<integer>::min() || x > std::numeric_limits<integer>::max()) return false;
+				v = x;
+			} else {
+				unsigned long long x = std::stoull(s, &pos);
+				if (s.find('-') != std::string::npos || x > std::numeric_limits<integer>::max()) return false;
+				v = x;
+			}
+		} catch (std::exception&) {
+			return false;
+		}
+		return pos == s.size();
+	}
+	template<typename real>
+	static typename std::enable_if<std::is_floating_point<real>::value, bool>::type parse(const std::string& s, real& v) {
+		size_t pos = 0;
+		try {
+			v = std::stod(s, &pos);
+		} catch (std::exception&) {
+			return false;
+		}
+		return pos == s.size();
+	}
+
 	typedef std::string key;
 	struct value {
 		std::string value;
 		operator std::string() const { return value; }
-		template<typename numeric, typename = typename std::enable_if<std::is_arithmetic<numeric>::value, numeric>::type>
-		operator numeric() const { return numeric(std::stod(value)); }
 	};
 	std::map<key, value> meta;
+	std::set<key> known;
+	symbol agent_name;
+	symbol agent_role;
 };
 
 /**
@@ -58,13 +164,29 @@ protected:
 class random_agent : public agent {
 public:
 	random_agent(const std::string& args = "") : agent(args) {
-		if (meta.find("seed") != meta.end())
-			engine.seed(int(meta["seed"]));
+		prng::kind type = prng::minstd;
+		std::string rng;
+		if (option("rng", rng) && !prng::parse(rng, type)) invalid("rng");
+		long long seed = 1;
+		unsigned stream = 0;
+		option("seed", seed);
+		option("stream", stream);
+		engine = prng(type, this->seed = seed);
+		while (stream--) engine.jump();
 	}
 	virtual ~random_agent() {}
 
+	/**
+	 * reseed with the i-th stream of the seed, so that episode i is
+	 * played with the same random sequence regardless of the episodes played before
+	 */
+	virtual void reseed(size_t episode) {
+		engine.seed(prng::stream(seed, episode));
+	}
+
 protected:
-	std::default_random_engine engine;
+	prng engine;
+	uint64_t seed;
 };
 
 /**
@@ -72,118 +194,394 @@ protected:
  */
 class weight_agent : public agent {
 public:
-	weight_agent(const std::string& args = "") : agent("name=weight_agent role=environment " + args), alpha(0) {
-		if (meta.find("init") != meta.end())
-			init_weights(meta["init"]);
-		if (meta.find("load") != meta.end())
-			load_weights(meta["load"]);
-		if (meta.find("alpha") != meta.end())
-			alpha = float(meta["alpha"]);
+	weight_agent(const std::string& args = "") : agent("name=weight_agent role=environment " + args),
+		alpha(0), lambda(0), nstep(1), tc(false), interval(0), episodes(0), writing(false) {
+		std::string stage, init, load;
+		option("tc", tc);
+		stride = tc ? 3 : 1;
+		option("stage", stage);
+		init_stages(stage);
+		if (option("init", init))
+			init_weights(init);
+		if (option("load", load))
+			load_weights(load);
+		option("alpha", alpha);
+		init_schedule();
+		if (option("lambda", lambda) && !(lambda >= 0 && lambda <= 1)) invalid("lambda");
+		if (option("nstep", nstep) && nstep < 1) invalid("nstep");
+		if (lambda > 0 && nstep > 1) {
+			std::cerr << name() << ": lambda and nstep cannot be used together (lambda is for TD(lambda), nstep for n-step TD)" << std::endl;
+			std::exit(-1);
+		}
+		option("save", save);
+		option("checkpoint", interval);
 	}
 	virtual ~weight_agent() {
-		if (meta.find("save") != meta.end())
-			save_weights(meta["save"]);
+		if (saver.joinable()) saver.join();
+		if (save.size())
+			save_weights(save);
 	}
 
 	virtual void open_episode(const std::string& flag = "") {
 		reward_history.clear();
 		board_history.clear();
 	}
+
+	/**
+	 * use the network of another agent without copying it, e.g., for the agents of other threads in evaluation
+	 * the other agent must outlive this one, and neither of them may learn while the network is shared
+	 */
+	void share(const weight_agent& source) {
+		net.clear();
+		net.reserve(source.net.size());
+		for (const weight& w : source.net) net.push_back(weight::view(w));
+		stride = source.stride;
+		stages = source.stages;
+		stage_of = source.stage_of;
+	}
+
+	/**
+	 * the current learning rate, which can be set to 0 to pause learning (and the schedule), e.g., for an evaluation,
+	 * and then set back to resume; setting another rate rescales the base rate so that the schedule goes on from it
+	 */
+	float learning_rate() const { return alpha; }
+	void learning_rate(float rate) {
+		if (rate != 0 && rate != float(base * sched.scale()))
+			base = sched.scale() > 0 ? rate / sched.scale() : rate;
+		alpha = rate;
+	}
+
+	/**
+	 * with 'block=avg' or 'eval=avg', advance the schedule if it is per block or per evaluation,
+	 * where avg is the average score of the block reported by the statistic, or that of the evaluation
+	 */
+	virtual void notify(const std::string& msg) {
+		agent::notify(msg);
+		std::string key = msg.substr(0, msg.find('='));
+		if (key == "block") anneal(rate_schedule::block, std::stod(property(key)));
+		if (key == "eval") anneal(rate_schedule::eval, std::stod(property(key)));
+	}
+
+	/**
+	 * save a snapshot of the network to the path of 'save' on a background thread, so that the caller is not blocked
+	 * the path can be followed by a suffix to keep the snapshot aside, e.g., "weights.bin.r10" for ".r10"
+	 * the tables are copied before returning, and written to temporary files which then replace the old ones
+	 * return false if there is no path to save, or if the previous snapshot is still being written (then it is skipped,
+	 * unless 'wait' is set, which waits for the previous one instead)
+	 */
+	bool checkpoint(const std::string& suffix = "", bool wait = false) {
+		if (save.empty() || (writing && !wait)) return false;
+		if (saver.joinable()) saver.join();
+		std::shared_ptr<std::vector<weight>> snap(new std::vector<weight>(net));
+		std::string path = save + suffix;
+		unsigned stride = this->stride, stages = this->stages;
+		writing = true;
+		saver = std::thread([this, snap, path, stride, stages]() {
+			if (!write_weights(path, *snap, stride, stages))
+				std::cerr << "failed to save the snapshot to " << path << std::endl;
+			writing = false;
+		});
+		return true;
+	}
 	
+	/**
+	 * update the afterstates backward from the end of the episode
+	 * the target is the lambda-return by default (lambda=0 is TD(0)), or the n-step return if nstep > 1
+	 * both returns are accumulated during the single backward scan
+	 */
 	virtual void close_episode(const std::string& flag = "") {
 		if(board_history.empty()) return;
 		if(alpha==0) return;
-		adjust_table(board_history[board_history.size()-1],0);
-		for(int t=board_history.size()-2;t>=0;t--){
-			adjust_table(board_history[t],reward_history[t+1]+v_value(board_history[t+1]));
+		update_episode();
+		anneal(rate_schedule::episode);
+		if(interval && ++episodes%interval==0) checkpoint();
+	}
+	void update_episode() {
+		int last=board_history.size()-1;
+		adjust_table(board_history[last],0);
+		if(nstep>1){
+			float sum=0; // rewards of the next n moves
+			for(int t=last-1;t>=0;t--){
+				sum+=reward_history[t+1];
+				if(t+nstep+1<=last) sum-=reward_history[t+nstep+1];
+				float target=sum;
+				if(t+nstep<=last) target+=v_value(board_history[t+nstep]);
+				adjust_table(board_history[t],target);
+			}
+		}else{
+			float ret=0; // lambda-return of the next afterstate
+			for(int t=last-1;t>=0;t--){
+				ret=reward_history[t+1]+(1-lambda)*v_value(board_history[t+1])+lambda*ret;
+				adjust_table(board_history[t],ret);
+			}
 		}
 	}
 
+	/**
+	 * the index of the i-th 4-tuple feature, i.e., row i for i < 4, or column (i - 4) for i >= 4
+	 */
+	static size_t index(const board& after, unsigned i) {
+		unsigned base = i < 4 ? i * 4 : i - 4, step = i < 4 ? 1 : 4;
+		return after(base)*25*25*25+after(base+step)*25*25+after(base+step*2)*25+after(base+step*3);
+	}
+
+	/**
+	 * the stage of an afterstate, selected by its largest tile through the precomputed milestone table
+	 */
+	unsigned stage(const board& after) const {
+		if (stages == 1) return 0;
+		unsigned max = 0;
+		for (unsigned i = 0; i < 16; i++) max = std::max(max, after(i));
+		return stage_of[max];
+	}
+
 	float v_value(const board& after) const{
+		const weight* w=&net[stage(after)*8];
 		float val=0;
-		val+=net[0][after(0)*25*25*25+after(1)*25*25+after(2)*25+after(3)];
-		val+=net[1][after(4)*25*25*25+after(5)*25*25+after(6)*25+after(7)];
-		val+=net[2][after(8)*25*25*25+after(9)*25*25+after(10)*25+after(11)];
-		val+=net[3][after(12)*25*25*25+after(13)*25*25+after(14)*25+after(15)];
-		val+=net[4][after(0)*25*25*25+after(4)*25*25+after(8)*25+after(12)];
-		val+=net[5][after(1)*25*25*25+after(5)*25*25+after(9)*25+after(13)];
-		val+=net[6][after(2)*25*25*25+after(6)*25*25+after(10)*25+after(14)];
-		val+=net[7][after(3)*25*25*25+after(7)*25*25+after(11)*25+after(15)];
+		for(unsigned i=0;i<8;i++) val+=w[i][index(after,i)*stride];
 		return val;
 	}
 
+	/**
+	 * evaluate a batch of afterstates, the value of after[k] is stored to value[k]
+	 * the gathers are ordered table by table, so that a table stays in cache for the whole chunk,
+	 * and the indices are computed before the gather loop, which is then vectorizable
+	 */
+	void v_value(const board* after, size_t n, float* value) const{
+		const size_t chunk=64;
+		uint32_t idx[8][chunk];
+		unsigned char st[chunk];
+		for(size_t base=0;base<n;base+=chunk){
+			size_t len=std::min(chunk,n-base);
+			for(size_t k=0;k<len;k++){
+				for(unsigned i=0;i<8;i++) idx[i][k]=index(after[base+k],i)*stride;
+				st[k]=stage(after[base+k]);
+			}
+			std::fill(value+base,value+base+len,0.0f);
+			for(unsigned i=0;i<8;i++){
+				if(stages==1){
+					const weight::type* w=&net[i][0];
+					for(size_t k=0;k<len;k++) value[base+k]+=w[idx[i][k]];
+				}else{
+					for(size_t k=0;k<len;k++) value[base+k]+=net[st[k]*8+i][idx[i][k]];
+				}
+			}
+		}
+	}
+
+	/**
+	 * with temporal coherence (tc), each entry is adjusted by alpha * |E| / A,
+	 * where E and A are the accumulated error and absolute error of the entry,
+	 * which are stored right after the weight of the entry, i.e., as (w, E, A)
+	 */
 	void adjust_table(const board& after, float target){
 		float current=v_value(after);
 		float error=target-current;
 		float adjust=alpha*error;
-		net[0][after(0)*25*25*25+after(1)*25*25+after(2)*25+after(3)]+=adjust;
-		net[1][after(4)*25*25*25+after(5)*25*25+after(6)*25+after(7)]+=adjust;
-		net[2][after(8)*25*25*25+after(9)*25*25+after(10)*25+after(11)]+=adjust;
-		net[3][after(12)*25*25*25+after(13)*25*25+after(14)*25+after(15)]+=adjust;
-		net[4][after(0)*25*25*25+after(4)*25*25+after(8)*25+after(12)]+=adjust;
-		net[5][after(1)*25*25*25+after(5)*25*25+after(9)*25+after(13)]+=adjust;
-		net[6][after(2)*25*25*25+after(6)*25*25+after(10)*25+after(14)]+=adjust;
-		net[7][after(3)*25*25*25+after(7)*25*25+after(11)*25+after(15)]+=adjust;
+		unsigned offset=stage(after)*8;
+		if(!tc){
+			for(unsigned i=0;i<8;i++) net[offset+i][index(after,i)]+=adjust;
+			return;
+		}
+		for(unsigned i=0;i<8;i++){
+			weight::type* e=&net[offset+i][index(after,i)*3];
+			e[0]+=e[2] ? adjust*std::abs(e[1])/e[2] : adjust;
+			e[1]+=error;
+			e[2]+=std::abs(error);
+		}
 	}
 
 protected:
 	virtual void init_weights(const std::string& info) {
 //		net.emplace_back(65536); // create an empty weight table with size 65536
 //		net.emplace_back(65536); // create an empty weight table with size 65536
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
-		net.emplace_back(25*25*25*25);
+		for (unsigned s = 0; s < stages; s++) {
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+			net.emplace_back(25*25*25*25*stride);
+		}
 	}
+	/**
+	 * each stage is stored in its own file, i.e., "weights.bin", "weights.bin.1", "weights.bin.2", ...
+	 * a stage without a file is initialized as a copy of its previous stage (including its coherence tables),
+	 * and with tc, a stage whose file has no coherence tables starts with clean ones
+	 */
 	virtual void load_weights(const std::string& path) {
-		std::ifstream in(path, std::ios::in | std::ios::binary);
-		if (!in.is_open()) std::exit(-1);
-		uint32_t size;
-		in.read(reinterpret_cast<char*>(&size), sizeof(size));
-		net.resize(size);
-		for (weight& w : net) in >> w;
-		in.close();
+		net.clear();
+		for (unsigned s = 0; s < stages; s++) {
+			std::ifstream in(stage_path(path, s), std::ios::in | std::ios::binary);
+			if (!in.is_open()) {
+				if (s == 0) std::exit(-1);
+				std::vector<weight> prev(net.end() - 8, net.end());
+				net.insert(net.end(), prev.begin(), prev.end());
+				continue;
+			}
+			uint32_t size;
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+			std::vector<weight> w(size), ea;
+			for (weight& t : w) in >> t;
+			if (tc && in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+				ea.resize(size);
+				for (weight& t : ea) in >> t;
+			}
+			for (size_t i = 0; i < w.size(); i++) {
+				if (tc) net.push_back(interleave(w[i], i < ea.size() ? &ea[i] : nullptr));
+				else net.push_back(std::move(w[i]));
+			}
+			in.close();
+		}
 	}
 	virtual void save_weights(const std::string& path) {
-		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
-		if (!out.is_open()) std::exit(-1);
-		uint32_t size = net.size();
-		out.write(reinterpret_cast<char*>(&size), sizeof(size));
-		for (weight& w : net) out << w;
-		out.close();
+		if (!write_weights(path, net, stride, stages)) std::exit(-1);
 	}
-	
+	/**
+	 * write the tables of each stage to its file, where the weights of all the tables come first,
+	 * followed by the coherence tables (E, A) of the stage if the entries are (w, E, A)
+	 * so the file layout does not depend on the interleaving in memory
+	 * a file is written as 'path.tmp', synced, and then renamed to 'path', so an existing file is never left truncated
+	 * return false if any file cannot be written
+	 */
+	static bool write_weights(const std::string& path, const std::vector<weight>& net, unsigned stride, unsigned stages) {
+		size_t per = net.size() / stages;
+		for (unsigned s = 0; s < stages; s++) {
+			std::string file = stage_path(path, s), temp = file + ".tmp";
+			std::ofstream out(temp, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) return false;
+			uint32_t size = per;
+			out.write(reinterpret_cast<char*>(&size), sizeof(size));
+			for (size_t i = 0; i < per; i++) {
+				if (stride == 1) out << net[s * per + i];
+				else out << select(net[s * per + i], stride, 0, 1);
+			}
+			if (stride > 1) {
+				out.write(reinterpret_cast<char*>(&size), sizeof(size));
+				for (size_t i = 0; i < per; i++) out << select(net[s * per + i], stride, 1, 2);
+			}
+			out.close();
+			if (!out) return false;
+			int fd = ::open(temp.c_str(), O_RDONLY);
+			if (fd >= 0) ::fsync(fd), ::close(fd);
+			if (std::rename(temp.c_str(), file.c_str()) != 0) return false;
+		}
+		return true;
+	}
+	static std::string stage_path(const std::string& path, unsigned s) {
+		return s ? path + "." + std::to_string(s) : path;
+	}
+	/**
+	 * parse the milestones of stages, e.g., "1597,2584" for 3 stages: < 1597, < 2584, and >= 2584
+	 * the milestones must be positive and increasing, where a milestone counts as the smallest tile not below it
+	 */
+	virtual void init_stages(const std::string& milestones) {
+		stages = 1;
+		stage_of.fill(0);
+		std::stringstream ss(milestones);
+		unsigned last = 0;
+		for (std::string tile; std::getline(ss, tile, ','); ) {
+			unsigned value = 0, t = 1;
+			if (!parse(tile, value) || value == 0) invalid("stage");
+			while (t < 32 && unsigned(board::fib(t)) < value) t++;
+			if (t >= 32 || t <= last) invalid("stage");
+			std::fill(stage_of.begin() + t, stage_of.end(), stages++);
+			last = t;
+		}
+	}
+	/**
+	 * build a table of (w, E, A) entries from a table of weights and its table of (E, A) pairs (or clean ones if null)
+	 */
+	static weight interleave(const weight& w, const weight* ea) {
+		weight t(w.size() * 3);
+		for (size_t j = 0; j < w.size(); j++) {
+			t[j * 3] = w[j];
+			if (ea) t[j * 3 + 1] = (*ea)[j * 2], t[j * 3 + 2] = (*ea)[j * 2 + 1];
+		}
+		return t;
+	}
+	/**
+	 * extract 'width' consecutive values starting at 'first' from each entry of a table of 'stride' values per entry
+	 */
+	static weight select(const weight& t, unsigned stride, unsigned first, unsigned width) {
+		size_t n = t.size() / stride;
+		weight w(n * width);
+		for (size_t j = 0; j < n; j++) {
+			for (unsigned k = 0; k < width; k++) w[j * width + k] = t[j * stride + first + k];
+		}
+		return w;
+	}
+	/**
+	 * parse the learning rate schedule, e.g., "schedule=step per=block period=100 decay=0.5",
+	 * where the learning rate is alpha scaled by the schedule (see rate_schedule)
+	 */
+	virtual void init_schedule() {
+		rate_schedule::kind type = rate_schedule::constant;
+		rate_schedule::unit per = rate_schedule::episode;
+		std::string kind, unit;
+		double period = 1, decay = 0.5;
+		unsigned patience = 1;
+		if (option("schedule", kind) && !rate_schedule::parse(kind, type)) invalid("schedule");
+		if (option("per", unit) && !rate_schedule::parse(unit, per)) invalid("per");
+		if (option("period", period) && !(period > 0)) invalid("period");
+		if (option("decay", decay) && !(decay > 0 && decay <= 1)) invalid("decay");
+		if (option("patience", patience) && patience == 0) invalid("patience");
+		if (type == rate_schedule::plateau && per == rate_schedule::episode) {
+			std::cerr << name() << ": schedule=plateau requires per=block or per=eval" << std::endl;
+			std::exit(-1);
+		}
+		sched = rate_schedule(type, per, period, decay, patience);
+		base = alpha;
+	}
+	/**
+	 * advance the schedule by a unit of training, which is skipped while not learning (alpha=0)
+	 */
+	void anneal(rate_schedule::unit per, double average = 0) {
+		if (alpha == 0 || per != sched.granularity()) return;
+		alpha = base * sched.advance(average);
+	}
+
+public:
 	virtual action take_action(const board& before) {
-		int best_move=-1;
-		int max_reward=-1;
-		float max_val=-std::numeric_limits<float>::max();
-		board next_board;
+		board after[4];
+		board::reward reward[4];
+		int code[4], n=0;
 		for (int op=0;op<4;op++) {
-			board after = before;
-			board::reward r = after.slide(op);
-			if(r==-1) continue;
-			float val=v_value(after);
-			if (r+val>max_reward+max_val){
-				best_move=op;
-				max_reward=r;
-				max_val=val;
-				next_board=after;
-			}
+			after[n] = before;
+			reward[n] = after[n].slide(op);
+			if(reward[n]!=-1) code[n++]=op;
 		}
-		if(best_move!=-1){
-			reward_history.push_back(max_reward);
-			board_history.push_back(next_board);
+		float val[4];
+		v_value(after,n,val);
+
+		int best=-1;
+		for (int i=0;i<n;i++) {
+			if (best==-1 || reward[i]+val[i]>reward[best]+val[best]) best=i;
 		}
-		return action::slide(best_move);
+		if(best==-1) return action::slide(-1);
+		reward_history.push_back(reward[best]);
+		board_history.push_back(after[best]);
+		return action::slide(code[best]);
 	}
 
 protected:
 	std::vector<weight> net;
 	float alpha;
+	float base; // the learning rate before scaled by the schedule
+	rate_schedule sched;
+	float lambda;
+	int nstep;
+	bool tc;
+	unsigned stride; // the values per entry, i.e., 3 for (w, E, A) with tc, or 1 for w only
+	std::string save;
+	unsigned interval; // the episodes between checkpoints while training, or 0 for none
+	size_t episodes;
+	std::thread saver; // the writer of the last snapshot
+	std::atomic<bool> writing;
+	unsigned stages;
+	std::array<unsigned char, 64> stage_of;
 	std::vector<int> reward_history;
 	std::vector<board> board_history;
 };
@@ -197,22 +595,20 @@ protected:
  */
 class rndenv : public random_agent {
 public:
-	rndenv(const std::string& args = "") : random_agent("name=random role=environment " + args),
-		space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), popup(0, 9) {}
+	rndenv(const std::string& args = "") : random_agent("name=random role=environment " + args) {}
 
+	/**
+	 * place at a uniformly random empty cell, drawn as the k-th set bit of the empty mask
+	 */
 	virtual action take_action(const board& after) {
-		std::shuffle(space.begin(), space.end(), engine);
-		for (int pos : space) {
-			if (after(pos) != 0) continue;
-			board::cell tile = popup(engine) ? 1 : 2;
-			return action::place(pos, tile);
-		}
-		return action();
+		uint32_t mask = after.empty();
+		if (mask == 0) return action();
+		unsigned k = engine.bounded(__builtin_popcount(mask));
+		while (k--) mask &= mask - 1;
+		unsigned pos = __builtin_ctz(mask);
+		board::cell tile = engine.bounded(10) ? 1 : 2;
+		return action::place(pos, tile);
 	}
-
-private:
-	std::array<int, 16> space;
-	std::uniform_int_distribution<int> popup;
 };
 
 /**
@@ -272,3 +668,177 @@ public:
 private:
 	std::array<int, 4> opcode;
 };
+
+/**
+ * monte carlo tree search player
+ * UCT over the player moves, with spawns sampled as the random environment does
+ * leaves are evaluated by the n-tuple network (rollout=0), or by short greedy rollouts
+ *
+ * the search tree is kept in a node pool which is reserved once and reused between moves
+ */
+class mcts_agent : public weight_agent {
+public:
+	mcts_agent(const std::string& args = "") : weight_agent("name=mcts role=player " + args),
+		sim(100), rollout(0), explore(0.5),
+		env((meta.count("seed") ? "seed=" + property("seed") : "") + (meta.count("rng") ? " rng=" + property("rng") : "")) {
+		known.insert({ "seed", "rng" }); // forwarded to the environment, which validates them
+		if (option("sim", sim) && sim == 0) invalid("sim");
+		option("rollout", rollout);
+		option("uct", explore);
+		pool.reserve(sim * 5 + 1); // one expansion (4 afterstates) and one new state per simulation
+	}
+
+	virtual void reseed(size_t episode) {
+		env.reseed(episode);
+	}
+
+	virtual action take_action(const board& before) {
+		pool.clear();
+		pool.emplace_back(before);
+		for (unsigned i = 0; i < sim; i++) select(0);
+
+		unsigned best = 0;
+		float max_q = -std::numeric_limits<float>::max();
+		for (unsigned c = pool[0].child; c; c = pool[c].sibling) {
+			if (q_value(pool[c]) > max_q) {
+				best = c;
+				max_q = q_value(pool[c]);
+			}
+		}
+		if (best) return action::slide(pool[best].code);
+		return action();
+	}
+
+protected:
+	/**
+	 * a node is either a state before a player move, or an afterstate waiting for a spawn
+	 * children are linked through 'sibling', index 0 (the root) terminates the list
+	 */
+	struct node {
+		board state;
+		unsigned child;
+		unsigned sibling;
+		unsigned code;
+		unsigned visits;
+		float total;
+		board::reward reward;
+		node(const board& state = {}, unsigned code = -1u, board::reward reward = 0) :
+			state(state), child(0), sibling(0), code(code), visits(0), total(0), reward(reward) {}
+	};
+
+	/**
+	 * the value of taking the move leading to an afterstate
+	 */
+	static float q_value(const node& after) {
+		return after.reward + after.total / after.visits;
+	}
+
+	/**
+	 * run a simulation from a state before a player move, return the value of the state
+	 * a state is expanded at its first visit, where all its afterstates are evaluated
+	 */
+	float select(unsigned idx) {
+		float value;
+		if (pool[idx].visits == 0) {
+			value = expand(idx);
+		} else if (pool[idx].child == 0) {
+			value = 0;
+		} else {
+			float min_q = std::numeric_limits<float>::max(), max_q = -min_q;
+			for (unsigned c = pool[idx].child; c; c = pool[c].sibling) {
+				min_q = std::min(min_q, q_value(pool[c]));
+				max_q = std::max(max_q, q_value(pool[c]));
+			}
+			float range = std::max(max_q - min_q, 1.0f); // normalize the values among siblings to [0, 1]
+			float logn = std::log(float(pool[idx].visits));
+			unsigned next = 0;
+			float max_score = -std::numeric_limits<float>::max();
+			for (unsigned c = pool[idx].child; c; c = pool[c].sibling) {
+				float score = (q_value(pool[c]) - min_q) / range + explore * std::sqrt(logn / pool[c].visits);
+				if (score > max_score) {
+					next = c;
+					max_score = score;
+				}
+			}
+			value = pool[next].reward + sample(next);
+		}
+		pool[idx].visits++;
+		pool[idx].total += value;
+		return value;
+	}
+
+	/**
+	 * run a simulation from an afterstate, return the value of the afterstate
+	 */
+	float sample(unsigned idx) {
+		board spawn = pool[idx].state;
+		action place = env.take_action(spawn);
+		place.apply(spawn);
+		unsigned next = pool[idx].child;
+		while (next && pool[next].code != unsigned(place)) next = pool[next].sibling;
+		if (next == 0) {
+			next = pool.size();
+			pool.emplace_back(spawn, place);
+			pool[next].sibling = pool[idx].child;
+			pool[idx].child = next;
+		}
+		float value = select(next);
+		pool[idx].visits++;
+		pool[idx].total += value;
+		return value;
+	}
+
+	/**
+	 * create and evaluate all the afterstates of a state, return the best value among them
+	 */
+	float expand(unsigned idx) {
+		board after[4];
+		board::reward reward[4];
+		unsigned code[4], n = 0;
+		for (unsigned op = 0; op < 4; op++) {
+			after[n] = pool[idx].state;
+			reward[n] = after[n].slide(op);
+			if (reward[n] != -1) code[n++] = op;
+		}
+		float total[4];
+		if (rollout == 0 && net.size()) {
+			v_value(after, n, total);
+		} else {
+			for (unsigned i = 0; i < n; i++) total[i] = evaluate(after[i]);
+		}
+
+		float value = 0;
+		for (unsigned i = 0; i < n; i++) {
+			unsigned next = pool.size();
+			pool.emplace_back(after[i], code[i], reward[i]);
+			pool[next].sibling = pool[idx].child;
+			pool[idx].child = next;
+			pool[next].visits = 1;
+			pool[next].total = total[i];
+			value = std::max(value, q_value(pool[next]));
+		}
+		return value;
+	}
+
+	float evaluate(const board& after) {
+		if (rollout == 0) return net.size() ? v_value(after) : 0;
+		board state = after;
+		float value = 0;
+		for (unsigned i = 0; i < rollout; i++) {
+			action place = env.take_action(state);
+			if (place.apply(state) == -1) return value;
+			board::reward r = greedy.take_action(state).apply(state);
+			if (r == -1) return value;
+			value += r;
+		}
+		return value + (net.size() ? v_value(state) : 0);
+	}
+
+private:
+	unsigned sim;
+	unsigned rollout;
+	float explore;
+	rndenv env;
+	player greedy;
+	std::vector<node> pool;
+};
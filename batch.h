@@ -0,0 +1,139 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * batch.h: Lockstep engine of multiple games for evaluation
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <map>
+#include <string>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistic.h"
+#include "recorder.h"
+
+/**
+ * play the remaining episodes of a statistic as K games in lockstep
+ *
+ * each round slides all the K games, with the afterstates of all the games evaluated by a single batch,
+ * and then spawns a tile in all of them; a finished game is replaced by the next episode in its slot
+ * the afterstates, rewards, and values of a round are kept in flat arrays, while the games stay in their episodes
+ *
+ * the player is the greedy afterstate policy of weight_agent (i.e., weight_agent::take_action without learning),
+ * and each slot has its own environment, which is reseeded with i for episode i as runner does,
+ * so the records are the same as those of runner with the same seed, except for the timing fields
+ * the time of a move in a round is the time of the round divided by the number of games,
+ * while an episode is open for about K times as long as it would be alone, so the overall ops of a block is per game
+ */
+class batch {
+public:
+	batch(unsigned k) : k(std::max(k, 1u)), after(4 * k), reward(4 * k), value(4 * k), owner(4 * k), op(4 * k) {}
+
+	void run(statistic& stat, weight_agent& play, const std::string& evil_args, recorder* logger = nullptr) {
+		next = merged = stat.played();
+		end = next + stat.remaining();
+		game.clear();
+		game.resize(k);
+		index.assign(k, end);
+		evil.assign(k, rndenv(evil_args));
+		tag = play.name() + ":" + evil[0].name();
+
+		std::vector<unsigned> live, slid;
+		std::vector<action> place(k);
+		std::vector<int> best(k);
+		for (unsigned j = 0; j < k; j++) if (start(j)) live.push_back(j);
+
+		while (live.size()) {
+			// slide all the live games, with the afterstates of all the games evaluated together
+			time_t t0 = episode::nanosec();
+			size_t n = 0;
+			for (unsigned o = 0; o < 4; o++) {
+				for (unsigned j : live) {
+					after[n] = game[j].state();
+					reward[n] = after[n].slide(o);
+					owner[n] = j;
+					op[n] = o;
+					n += (reward[n] != -1);
+				}
+			}
+			play.v_value(after.data(), n, value.data());
+			for (unsigned j : live) best[j] = -1;
+			for (size_t i = 0; i < n; i++) {
+				int& b = best[owner[i]];
+				if (b == -1 || reward[i] + value[i] > reward[b] + value[b]) b = i;
+			}
+			time_t spent = (episode::nanosec() - t0) / live.size();
+
+			slid.clear();
+			for (unsigned j : live) {
+				if (best[j] != -1 && game[j].apply_action(action::slide(op[best[j]]), spent)) {
+					slid.push_back(j);
+				} else {
+					finish(j, stat, logger);
+				}
+			}
+
+			// spawn a tile in all the slid games
+			t0 = episode::nanosec();
+			for (unsigned j : slid) place[j] = evil[j].take_action(game[j].state());
+			spent = slid.size() ? (episode::nanosec() - t0) / slid.size() : 0;
+			for (unsigned j : slid) game[j].apply_action(place[j], spent);
+
+			live.clear();
+			for (unsigned j = 0; j < k; j++) if (index[j] < end) live.push_back(j);
+		}
+	}
+
+private:
+	/**
+	 * open the next episode in a slot, with its first two tiles spawned
+	 * return false if there is no more episode
+	 */
+	bool start(unsigned j) {
+		index[j] = next < end ? next++ : end;
+		if (index[j] == end) return false;
+		evil[j].reseed(index[j]);
+		game[j].clear();
+		game[j].open_episode(tag);
+		for (int i = 0; i < 2; i++) {
+			time_t t0 = episode::nanosec();
+			action place = evil[j].take_action(game[j].state());
+			game[j].apply_action(place, episode::nanosec() - t0);
+		}
+		return true;
+	}
+
+	/**
+	 * close the game in a slot, merge the finished episodes in order, and start the next episode in the slot
+	 */
+	void finish(unsigned j, statistic& stat, recorder* logger) {
+		game[j].close_episode(evil[j].name());
+		pending.emplace(index[j], std::move(game[j]));
+		for (auto it = pending.begin(); it != pending.end() && it->first == merged; it = pending.erase(it), merged++) {
+			stat.append(std::move(it->second));
+			if (logger) logger->append(stat.back());
+		}
+		start(j);
+	}
+
+private:
+	unsigned k;
+	size_t next, end, merged;
+	symbol tag;
+	std::vector<episode> game;
+	std::vector<size_t> index;
+	std::vector<rndenv> evil;
+	std::map<size_t, episode> pending;
+
+	std::vector<board> after;
+	std::vector<board::reward> reward;
+	std::vector<float> value;
+	std::vector<unsigned> owner;
+	std::vector<unsigned> op;
+};
@@ -63,6 +63,15 @@ public:
 
 public:
 
+	/**
+	 * the mask of empty cells, where bit i is set if the cell at position i (1-d form index) is empty
+	 */
+	uint32_t empty() const {
+		uint32_t mask = 0;
+		for (unsigned i = 0; i < 16; i++) mask |= uint32_t(operator()(i) == 0) << i;
+		return mask;
+	}
+
 	/**
 	 * place a tile (index value) to the specific position (1-d form index)
 	 * return 0 if the action is valid, or -1 if not
@@ -0,0 +1,115 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * driver.h: Game driver for playing episodes with a pair of agents
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <type_traits>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "symbol.h"
+#include "statistic.h"
+#include "recorder.h"
+
+/**
+ * drive the episodes between a player and an environment
+ *
+ * with the concrete types of the agents (e.g., driver<weight_agent, rndenv>), the calls to the agents
+ * are qualified by their types, so they are dispatched statically and can be inlined into the game loop,
+ * note that the agents must then be exactly of the given types, not of any derived type
+ * with the default driver<agent, agent>, the calls are virtual, which works with arbitrary agents
+ *
+ * the flags of the agents and the episodes are built and interned once, instead of once per episode
+ */
+template<class player = agent, class environment = agent>
+class driver {
+public:
+	driver(player& play, environment& evil) : play(play), evil(evil),
+		play_name(play.name()), evil_name(evil.name()),
+		play_flag("~:" + evil.name()), evil_flag(play.name() + ":~"), game_flag(play.name() + ":" + evil.name()) {}
+
+	/**
+	 * the flag for opening an episode in the statistic, as 'player:environment'
+	 */
+	symbol flag() const { return game_flag; }
+
+	void open_episode() {
+		call<player>::open_episode(play, play_flag);
+		call<environment>::open_episode(evil, evil_flag);
+	}
+
+	/**
+	 * play an opened episode until either agent fails to move or wins
+	 * return the name of the winner, for closing the episode
+	 */
+	symbol play_episode(episode& game) {
+		while (true) {
+			time_t start = episode::nanosec();
+			if (episode::turn(game.step()) == action::slide::type) {
+				action move = call<player>::take_action(play, game.state());
+				if (game.apply_action(move, episode::nanosec() - start) != true) return evil_name;
+				if (call<player>::check_for_win(play, game.state())) return play_name;
+			} else {
+				action move = call<environment>::take_action(evil, game.state());
+				if (game.apply_action(move, episode::nanosec() - start) != true) return play_name;
+				if (call<environment>::check_for_win(evil, game.state())) return evil_name;
+			}
+		}
+	}
+
+	void close_episode(symbol win) {
+		call<player>::close_episode(play, win);
+		call<environment>::close_episode(evil, win);
+	}
+
+private:
+	/**
+	 * the calls to an agent of the given type, which are qualified unless the type is the abstract agent
+	 */
+	template<class type, bool dynamic = std::is_same<type, agent>::value>
+	struct call {
+		static action take_action(type& who, const board& b) { return who.type::take_action(b); }
+		static bool check_for_win(type& who, const board& b) { return who.type::check_for_win(b); }
+		static void open_episode(type& who, const std::string& flag) { who.type::open_episode(flag); }
+		static void close_episode(type& who, const std::string& flag) { who.type::close_episode(flag); }
+	};
+	template<class type>
+	struct call<type, true> {
+		static action take_action(type& who, const board& b) { return who.take_action(b); }
+		static bool check_for_win(type& who, const board& b) { return who.check_for_win(b); }
+		static void open_episode(type& who, const std::string& flag) { who.open_episode(flag); }
+		static void close_episode(type& who, const std::string& flag) { who.close_episode(flag); }
+	};
+
+private:
+	player& play;
+	environment& evil;
+	symbol play_name, evil_name;
+	symbol play_flag, evil_flag, game_flag;
+};
+
+/**
+ * play the remaining episodes of the statistic in sequence
+ * the player is notified with 'block=avg' once a block is reported, where avg is the average score of the block
+ */
+template<class player, class environment>
+void play_episodes(statistic& stat, player& play, environment& evil, recorder* logger = nullptr) {
+	driver<player, environment> drive(play, evil);
+	while (!stat.is_finished()) {
+		drive.open_episode();
+		stat.open_episode(drive.flag());
+		episode& game = stat.back();
+		symbol win = drive.play_episode(game);
+		stat.close_episode(win);
+		if (logger) logger->append(game);
+		drive.close_episode(win);
+		if (stat.is_block_end()) play.notify("block=" + std::to_string(stat.block_average()));
+	}
+}
@@ -15,41 +15,70 @@
 #include <sstream>
 #include <chrono>
 #include <numeric>
+#include <cstring>
+#include <mutex>
 #include "board.h"
 #include "action.h"
-#include "agent.h"
+#include "histogram.h"
+#include "symbol.h"
 
 class statistic;
 
 class episode {
 friend class statistic;
 public:
-	episode() : ep_state(initial_state()), ep_score(0), ep_time(0) { ep_moves.reserve(10000); }
+	episode() : ep_state(initial_state()), ep_score(0), ep_spent(), ep_latency(nullptr) {}
 
 public:
 	board& state() { return ep_state; }
 	const board& state() const { return ep_state; }
 	board::reward score() const { return ep_score; }
 
-	void open_episode(const std::string& tag) {
+	/**
+	 * reset to an empty episode, the chunks of moves are returned to the pool for reuse
+	 */
+	void clear() {
+		ep_state = initial_state();
+		ep_score = 0;
+		ep_moves.clear();
+		ep_spent[0] = ep_spent[1] = 0;
+		ep_latency = nullptr;
+		ep_open = {};
+		ep_close = {};
+	}
+
+	void open_episode(symbol tag) {
 		ep_open = { tag, millisec() };
 	}
-	void close_episode(const std::string& tag) {
+	void close_episode(symbol tag) {
 		ep_close = { tag, millisec() };
 	}
-	bool apply_action(action move) {
+	/**
+	 * apply an action with the time spent on it in nanoseconds, which is measured by the caller
+	 */
+	bool apply_action(action move, time_t spent) {
 		board::reward reward = move.apply(state());
 		if (reward == -1) return false;
-		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		if (ep_latency) ep_latency[move.type() == action::place::type].record(spent);
+		record({ move, reward, spent });
 		ep_score += reward;
 		return true;
 	}
-	agent& take_turns(agent& play, agent& evil) {
-		ep_time = millisec();
-		return (std::max(step() + 1, size_t(2)) % 2) ? play : evil;
+
+	/**
+	 * record the latency of the following moves into the histograms of sliding and placing
+	 */
+	void attach(histogram* lat) {
+		ep_latency = lat;
 	}
-	agent& last_turns(agent& play, agent& evil) {
-		return take_turns(evil, play);
+	/**
+	 * record the latency of the existing moves (e.g., loaded ones) into the histograms of sliding and placing
+	 */
+	void latency(histogram* lat) const {
+		move_list::reader moves(ep_moves);
+		for (size_t i = 0; i < ep_moves.size(); i++) {
+			lat[turn(i) == action::place::type].record(moves.next().time);
+		}
 	}
 
 public:
@@ -62,66 +91,187 @@ public:
 		}
 	}
 
+	/**
+	 * the time spent in nanoseconds, by the given turn or by the whole episode
+	 */
 	time_t time(unsigned who = -1u) const {
-		time_t time = 0;
-		size_t i = 2;
 		switch (who) {
-		case action::place::type:
-			if (ep_moves.size()) time += ep_moves[0].time, i = 1;
-			// no break;
-		case action::slide::type:
-			while (i < ep_moves.size()) time += ep_moves[i].time, i += 2;
-			break;
-		default:
-			time = ep_close.when - ep_open.when;
-			break;
+		case action::slide::type: return ep_spent[0];
+		case action::place::type: return ep_spent[1];
+		default:                  return (ep_close.when - ep_open.when) * 1000000;
 		}
-		return time;
 	}
 
 	std::vector<action> actions(unsigned who = -1u) const {
 		std::vector<action> res;
-		size_t i = 2;
-		switch (who) {
-		case action::place::type:
-			if (ep_moves.size()) res.push_back(ep_moves[0]), i = 1;
-			// no break;
-		case action::slide::type:
-			while (i < ep_moves.size()) res.push_back(ep_moves[i]), i += 2;
-			break;
-		default:
-			res.assign(ep_moves.begin(), ep_moves.end());
-			break;
+		move_list::reader moves(ep_moves);
+		for (size_t i = 0; i < ep_moves.size(); i++) {
+			move mv = moves.next();
+			if (turn(i) == who || who == -1u) res.push_back(mv);
 		}
 		return res;
 	}
 
+	/**
+	 * the monotonic clock for measuring moves, which is not affected by adjustments of the wall clock
+	 */
+	static time_t nanosec() {
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+	}
+
+	/**
+	 * the type of the i-th move, the first two moves are both placing
+	 */
+	static unsigned turn(size_t i) {
+		return (i < 2 || i % 2) ? action::place::type : action::slide::type;
+	}
+
 public:
+	/**
+	 * report the memory held by the shared storage of moves, with the packed size of the given moves, e.g.,
+	 * memory = 4096 KB (1024 chunks, 1000 in use, 2.6 bytes/move)
+	 */
+	static void memory(size_t bytes, size_t moves, std::ostream& out = std::cout) {
+		const chunk_pool& p = pool();
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(0);
+		out << "memory = " << (p.allocated() * move_list::chunk_size / 1024.0) << " KB";
+		out << " (" << p.allocated() << " chunks, " << p.used() << " in use, ";
+		out << std::setprecision(1) << (moves ? double(bytes) / moves : 0) << " bytes/move)" << std::endl;
+		out.copyfmt(ff);
+	}
 
+	/**
+	 * the text form keeps the time of moves in milliseconds, where the time of a move is the difference
+	 * of the running time of its turn before and after it, both truncated to milliseconds,
+	 * so that the total time of each turn is kept, even though most moves take less than a millisecond
+	 */
 	friend std::ostream& operator <<(std::ostream& out, const episode& ep) {
 		out << ep.ep_open << '|';
-		for (const move& mv : ep.ep_moves) out << mv;
+		move_list::reader moves(ep.ep_moves);
+		time_t spent[2] = { 0, 0 };
+		for (size_t i = 0; i < ep.ep_moves.size(); i++) {
+			move mv = moves.next();
+			time_t& sum = spent[turn(i) == action::place::type];
+			time_t last = sum / 1000000;
+			sum += mv.time;
+			mv.time = (sum / 1000000 - last) * 1000000;
+			out << mv;
+		}
 		out << '|' << ep.ep_close;
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, episode& ep) {
-		ep = {};
+		ep.clear();
 		std::string token;
 		std::getline(in, token, '|');
 		std::stringstream(token) >> ep.ep_open;
 		std::getline(in, token, '|');
 		for (std::stringstream moves(token); !moves.eof(); moves.peek()) {
-			ep.ep_moves.emplace_back();
-			moves >> ep.ep_moves.back();
-			ep.ep_score += action(ep.ep_moves.back()).apply(ep.ep_state);
+			move mv;
+			moves >> mv;
+			ep.record(mv);
+			ep.ep_score += action(mv).apply(ep.ep_state);
 		}
 		std::getline(in, token, '|');
 		std::stringstream(token) >> ep.ep_close;
 		return in;
 	}
 
+	/**
+	 * parse an episode from a line of text in place, with the same result as operator >>
+	 * moves are decoded by a small state machine and replayed directly, without any stream or copy
+	 * if error is given, the moves are also validated while replaying, and the first violation is stored,
+	 * where a record should be 'open|moves|close', with the moves starting with the two opening placements
+	 * return the end of the line (the '\n' or the end of the text)
+	 */
+	const char* parse(const char* p, const char* end, std::string* error = nullptr) {
+		clear();
+		const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if (!eol) eol = end;
+		const char* sep = std::find(p, eol, '|');
+		if (error && std::count(p, eol, '|') != 2) *error = "malformed record (expected open|moves|close)";
+		parse_meta(p, sep, ep_open);
+		p = std::min(sep + 1, eol);
+		sep = std::find(p, eol, '|');
+		while (p < sep) {
+			move mv;
+			unsigned pos, tile;
+			if (p[0] == '#' && p + 1 < sep && (pos = digit(p[1], "URDL")) < 4) {
+				mv.code = action::slide(pos);
+			} else if ((pos = digit(p[0])) < 16 && p + 1 < sep && (tile = digit(p[1])) < 36) {
+				mv.code = action::place(pos, tile);
+			}
+			p += 2;
+			if (p < sep && *p == '[') p = parse_number(p + 1, sep, mv.reward) + 1;
+			if (p < sep && *p == '(') p = parse_number(p + 1, sep, mv.time) + 1, mv.time *= 1000000;
+			bool taken = mv.code.type() == action::place::type && ep_state(mv.code.event() & 0x0f); // placing on a tile
+			board::reward reward = action(mv).apply(ep_state);
+			if (error && error->empty()) validate(mv, taken ? -1 : reward, *error);
+			record(mv);
+			ep_score += reward;
+		}
+		if (error && error->empty() && ep_moves.size() < 2) *error = "missing the opening placements";
+		p = std::min(sep + 1, eol);
+		parse_meta(p, std::find(p, eol, '|'), ep_close);
+		return eol;
+	}
+
+	/**
+	 * binary form of an episode, as a 32-bit length followed by
+	 * varint when, varint length, and the tag of the opening and the closing,
+	 * varint number of moves, and the packed records of moves
+	 */
+	void write(std::string& out) const {
+		size_t begin = out.size();
+		out.append(4, 0);
+		for (const meta* m : { &ep_open, &ep_close }) {
+			unsigned char buf[20];
+			out.append(reinterpret_cast<char*>(buf), move_list::varint(buf, m->when) - buf);
+			const std::string& tag = m->tag;
+			out.append(reinterpret_cast<char*>(buf), move_list::varint(buf, tag.size()) - buf);
+			out.append(tag);
+		}
+		unsigned char buf[10];
+		out.append(reinterpret_cast<char*>(buf), move_list::varint(buf, ep_moves.size()) - buf);
+		ep_moves.dump(out);
+		uint32_t size = out.size() - begin - 4;
+		for (int i = 0; i < 4; i++) out[begin + i] = char(size >> (i * 8));
+	}
+	/**
+	 * read the body of a binary record (without its length), and replay the moves
+	 * return false if the record is malformed
+	 */
+	bool read(const unsigned char* p, size_t size) {
+		clear();
+		const unsigned char* end = p + size;
+		uint64_t v;
+		for (meta* m : { &ep_open, &ep_close }) {
+			if (!move_list::varint(p, end, v)) return false;
+			m->when = v;
+			if (!move_list::varint(p, end, v) || v > size_t(end - p)) return false;
+			m->tag = std::string(reinterpret_cast<const char*>(p), v);
+			p += v;
+		}
+		if (!move_list::varint(p, end, v)) return false;
+		ep_moves.assign(p, end - p, v);
+		move_list::reader moves(ep_moves);
+		for (size_t i = 0; i < ep_moves.size(); i++) {
+			move mv = moves.next();
+			ep_spent[turn(i) == action::place::type] += mv.time;
+			ep_score += action(mv).apply(ep_state);
+		}
+		return true;
+	}
+
 protected:
 
+	/**
+	 * a move with its reward and its time in nanoseconds,
+	 * while the text form keeps the time in milliseconds as the judge expects
+	 */
 	struct move {
 		action code;
 		board::reward reward;
@@ -132,7 +282,7 @@ protected:
 		friend std::ostream& operator <<(std::ostream& out, const move& m) {
 			out << m.code;
 			if (m.reward) out << '[' << std::dec << m.reward << ']';
-			if (m.time) out << '(' << std::dec << m.time << ')';
+			if (m.time >= 1000000) out << '(' << std::dec << (m.time / 1000000) << ')';
 			return out;
 		}
 		friend std::istream& operator >>(std::istream& in, move& m) {
@@ -147,6 +297,7 @@ protected:
 			if (in.peek() == '(') {
 				in.ignore(1);
 				in >> std::dec >> m.time;
+				m.time *= 1000000;
 				in.ignore(1);
 			}
 			return in;
@@ -154,18 +305,241 @@ protected:
 	};
 
 	struct meta {
-		std::string tag;
+		symbol tag; // interned, and rendered to text only when serialized
 		time_t when;
-		meta(const std::string& tag = "N/A", time_t when = 0) : tag(tag), when(when) {}
+		meta(symbol tag = {}, time_t when = 0) : tag(tag), when(when) {}
 
 		friend std::ostream& operator <<(std::ostream& out, const meta& m) {
 			return out << m.tag << "@" << std::dec << m.when;
 		}
 		friend std::istream& operator >>(std::istream& in, meta& m) {
-			return std::getline(in, m.tag, '@') >> std::dec >> m.when;
+			std::string tag;
+			std::getline(in, tag, '@') >> std::dec >> m.when;
+			m.tag = tag;
+			return in;
 		}
 	};
 
+	/**
+	 * storage of moves as packed records in fixed-size chunks taken from a shared pool
+	 * an episode grows chunk by chunk, and returns its chunks to the pool when it is cleared or destroyed
+	 *
+	 * a record starts with a header byte, followed by the optional fields
+	 *  bit 7: a varint of time follows
+	 *  bit 6: a varint of reward follows
+	 *  bit 5: placing, with the tile (1 or 2) in bit 4 and the position in bits 3-0
+	 *  otherwise, sliding with the opcode in bits 1-0, or an escape if bit 4 is set,
+	 *  where the raw 32-bit code follows (for actions not fitting the above)
+	 * the time is kept in ticks of 100 nanoseconds (rounded), which usually fits in a single byte
+	 * a record is usually 2-3 bytes, since most rewards are small
+	 */
+	class move_list {
+	public:
+		static constexpr size_t chunk_size = 4096;
+		static constexpr time_t tick = 100;
+
+		move_list() : bytes(0), count(0) {}
+		move_list(const move_list& l) : bytes(0), count(0) { operator =(l); }
+		move_list(move_list&& l) noexcept : chunks(std::move(l.chunks)), bytes(l.bytes), count(l.count) { l.chunks.clear(); l.bytes = l.count = 0; }
+		~move_list() { clear(); }
+
+		move_list& operator =(const move_list& l) {
+			if (this == &l) return *this;
+			clear();
+			reader moves(l);
+			for (size_t i = 0; i < l.size(); i++) push_back(moves.next());
+			return *this;
+		}
+		move_list& operator =(move_list&& l) noexcept {
+			std::swap(chunks, l.chunks);
+			std::swap(bytes, l.bytes);
+			std::swap(count, l.count);
+			return *this;
+		}
+
+		size_t size() const { return count; }
+		size_t packed() const { return bytes; }
+
+		void push_back(const move& mv) {
+			unsigned char buf[32], *p = buf + 1;
+			unsigned code = mv.code, type = mv.code.type(), event = mv.code.event();
+			if (type == action::slide::type && event < 4) {
+				buf[0] = event;
+			} else if (type == action::place::type && (event >> 4) - 1 < 2) {
+				buf[0] = 0x20 | ((event >> 4) - 1) << 4 | (event & 0x0f);
+			} else {
+				buf[0] = 0x10;
+				for (int i = 0; i < 4; i++) *(p++) = code >> (i * 8);
+			}
+			if (mv.reward) buf[0] |= 0x40, p = varint(p, mv.reward);
+			time_t ticks = (mv.time + tick / 2) / tick;
+			if (ticks) buf[0] |= 0x80, p = varint(p, ticks);
+			for (unsigned char* b = buf; b != p; b++) {
+				if (bytes == chunks.size() * chunk_size) chunks.push_back(pool().acquire());
+				chunks[bytes / chunk_size][bytes % chunk_size] = *b;
+				bytes++;
+			}
+			count++;
+		}
+		/**
+		 * append or assign the packed records as raw bytes
+		 */
+		void dump(std::string& out) const {
+			for (size_t i = 0; i < bytes; i += chunk_size)
+				out.append(reinterpret_cast<const char*>(chunks[i / chunk_size]), std::min(size_t(chunk_size), bytes - i));
+		}
+		void assign(const unsigned char* data, size_t size, size_t moves) {
+			clear();
+			for (size_t i = 0; i < size; i += chunk_size) {
+				chunks.push_back(pool().acquire());
+				std::copy(data + i, data + std::min(size, i + chunk_size), chunks.back());
+			}
+			bytes = size;
+			count = moves;
+		}
+
+		void clear() {
+			for (unsigned char* chunk : chunks) pool().release(chunk);
+			chunks.clear();
+			bytes = count = 0;
+		}
+
+		/**
+		 * sequential decoder of the records
+		 */
+		class reader {
+		public:
+			reader(const move_list& l) : l(l), pos(0) {}
+			move next() {
+				unsigned char head = get();
+				move mv;
+				if (head & 0x20) {
+					mv.code = action::place(head & 0x0f, ((head >> 4) & 1) + 1);
+				} else if (head & 0x10) {
+					unsigned code = 0;
+					for (int i = 0; i < 4; i++) code |= unsigned(get()) << (i * 8);
+					mv.code = action(code);
+				} else {
+					mv.code = action::slide(head & 0b11);
+				}
+				if (head & 0x40) mv.reward = varint();
+				if (head & 0x80) mv.time = varint() * tick;
+				return mv;
+			}
+		private:
+			unsigned char get() { size_t i = pos++; return i < l.bytes ? l.chunks[i / chunk_size][i % chunk_size] : 0; }
+			uint64_t varint() {
+				uint64_t v = 0;
+				for (int shift = 0; ; shift += 7) {
+					unsigned char b = get();
+					v |= uint64_t(b & 0x7f) << shift;
+					if (!(b & 0x80)) return v;
+				}
+			}
+			const move_list& l;
+			size_t pos;
+		};
+
+		static unsigned char* varint(unsigned char* p, uint64_t v) {
+			for (; v >= 0x80; v >>= 7) *(p++) = (v & 0x7f) | 0x80;
+			*(p++) = v;
+			return p;
+		}
+		static bool varint(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+			v = 0;
+			for (int shift = 0; p != end && shift < 64; shift += 7) {
+				unsigned char b = *(p++);
+				v |= uint64_t(b & 0x7f) << shift;
+				if (!(b & 0x80)) return true;
+			}
+			return false;
+		}
+
+	private:
+		std::vector<unsigned char*> chunks;
+		size_t bytes;
+		size_t count;
+	};
+
+	/**
+	 * the chunks are allocated on demand and never freed, released chunks are recycled
+	 * the pool is shared by all threads, and is guarded by a mutex (taken once per chunk)
+	 */
+	class chunk_pool {
+	public:
+		chunk_pool() : total(0) {}
+		~chunk_pool() { for (unsigned char* chunk : free) delete[] chunk; }
+
+		unsigned char* acquire() {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (free.empty()) {
+				total++;
+				return new unsigned char[move_list::chunk_size];
+			}
+			unsigned char* chunk = free.back();
+			free.pop_back();
+			return chunk;
+		}
+		void release(unsigned char* chunk) {
+			std::lock_guard<std::mutex> lock(mutex);
+			free.push_back(chunk);
+		}
+
+		size_t allocated() const { return total; }
+		size_t used() const { return total - free.size(); }
+
+	private:
+		std::vector<unsigned char*> free;
+		size_t total;
+		std::mutex mutex;
+	};
+
+	static chunk_pool& pool() { static chunk_pool p; return p; }
+
+	/**
+	 * check a move replayed as the next move, like the judge does
+	 * the move should be of the expected turn, legal, and with the correct reward
+	 */
+	void validate(const move& mv, board::reward reward, std::string& error) const {
+		std::stringstream ss;
+		size_t i = ep_moves.size();
+		if (mv.code.type() != turn(i)) {
+			ss << "unexpected action " << mv.code << " at move " << i;
+		} else if (reward == -1) {
+			ss << "illegal action " << mv.code << " at move " << i;
+		} else if (reward != mv.reward) {
+			ss << "incorrect reward of " << mv.code << " at move " << i << ": " << mv.reward << " (expected " << reward << ")";
+		}
+		error = ss.str();
+	}
+
+	/**
+	 * append a move, and accumulate the time spent by its turn
+	 */
+	void record(const move& mv) {
+		ep_spent[turn(ep_moves.size()) == action::place::type] += mv.time;
+		ep_moves.push_back(mv);
+	}
+
+	static unsigned digit(char c, const char* idx = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ") {
+		const char* pos = std::strchr(idx, c);
+		return (pos && c) ? pos - idx : -1u;
+	}
+	template<typename numeric>
+	static const char* parse_number(const char* p, const char* end, numeric& v) {
+		bool neg = (p < end && *p == '-');
+		v = 0;
+		for (p += neg; p < end && *p >= '0' && *p <= '9'; p++) v = v * 10 + (*p - '0');
+		if (neg) v = -v;
+		return p;
+	}
+	static void parse_meta(const char* p, const char* end, meta& m) {
+		const char* at = std::find(p, end, '@');
+		m.tag = std::string(p, at);
+		m.when = 0;
+		if (at != end) parse_number(at + 1, end, m.when);
+	}
+
 	static board initial_state() {
 		return {};
 	}
@@ -177,8 +551,9 @@ protected:
 private:
 	board ep_state;
 	board::reward ep_score;
-	std::vector<move> ep_moves;
-	time_t ep_time;
+	move_list ep_moves;
+	time_t ep_spent[2]; // the time spent by sliding and placing, in nanoseconds
+	histogram* ep_latency; // the histograms of sliding and placing, if attached
 
 	meta ep_open;
 	meta ep_close;
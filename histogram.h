@@ -0,0 +1,96 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * histogram.h: Log-bucketed histogram for recording latencies
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+/**
+ * histogram of non-negative values (e.g., nanoseconds), in the style of HdrHistogram
+ *
+ * values below 2^bits are counted exactly, and each larger power-of-two range [2^k, 2^(k+1))
+ * is split into 2^(bits-1) equal buckets, so that a value is kept with a relative error below 2^(1-bits)
+ * recording is a bit scan, a shift, and an increment, without any allocation
+ */
+class histogram {
+public:
+	static constexpr unsigned bits = 5; // 16 buckets per power of two, within 6.25% of the value
+	static constexpr unsigned half = 1u << (bits - 1);
+	static constexpr unsigned size = (64 - bits + 2) * half;
+
+	histogram() { clear(); }
+
+	void clear() {
+		count.fill(0);
+		n = 0;
+	}
+
+	void record(uint64_t v) {
+		count[index(v)]++;
+		n++;
+	}
+
+	histogram& operator +=(const histogram& h) {
+		for (unsigned i = 0; i < size; i++) count[i] += h.count[i];
+		n += h.n;
+		return *this;
+	}
+
+	uint64_t total() const { return n; }
+
+	/**
+	 * the value at the q-quantile (0 <= q <= 1), as the highest value of its bucket
+	 * return 0 if the histogram is empty
+	 */
+	uint64_t percentile(double q) const {
+		uint64_t rank = std::min<uint64_t>(q * n, n ? n - 1 : 0), seen = 0;
+		for (unsigned i = 0; i < size; i++) {
+			if ((seen += count[i]) > rank) return highest(i);
+		}
+		return 0;
+	}
+
+	/**
+	 * the non-empty buckets, one per line as
+	 * 'lowest highest count percentile', where percentile is the cumulative percentage
+	 */
+	friend std::ostream& operator <<(std::ostream& out, const histogram& h) {
+		uint64_t seen = 0;
+		for (unsigned i = 0; i < size; i++) {
+			if (h.count[i] == 0) continue;
+			seen += h.count[i];
+			out << lowest(i) << '\t' << highest(i) << '\t' << h.count[i] << '\t' << (seen * 100.0 / h.n) << std::endl;
+		}
+		return out;
+	}
+
+public:
+	static unsigned index(uint64_t v) {
+		unsigned msb = 63 - __builtin_clzll(v | 1);
+		if (msb < bits) return v;
+		unsigned shift = msb - (bits - 1);
+		return (shift << (bits - 1)) + (v >> shift);
+	}
+	static uint64_t lowest(unsigned i) {
+		if (i < 2 * half) return i;
+		unsigned shift = i / half - 1;
+		return uint64_t(i % half + half) << shift;
+	}
+	static uint64_t highest(unsigned i) {
+		if (i < 2 * half) return i;
+		unsigned shift = i / half - 1;
+		return (uint64_t(i % half + half + 1) << shift) - 1;
+	}
+
+private:
+	std::array<uint64_t, size> count;
+	uint64_t n;
+};
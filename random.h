@@ -0,0 +1,193 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * random.h: Pseudo-random number generators for agents
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <random>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+/**
+ * a pseudo-random number generator selected at runtime, which can be
+ * minstd: std::default_random_engine (minstd_rand0 on libstdc++), the default for reproducing existing runs
+ * xoshiro: xoshiro256**, with jump for 2^128 non-overlapping streams
+ * pcg: pcg32 (XSH-RR), with jump by 2^48 steps
+ * splitmix: splitmix64, with jump by 2^48 steps
+ *
+ * it is a uniform random bit generator of 64-bit values, and bounded integers are drawn by bounded
+ * note that minstd is always drawn through std::uniform_int_distribution, so that its sequences are unchanged
+ */
+class prng {
+public:
+	enum kind { minstd, xoshiro, pcg, splitmix };
+	typedef uint64_t result_type;
+
+	prng(kind type = minstd, uint64_t seed = 1) : type(type) { this->seed(seed); }
+
+	/**
+	 * parse the name of a generator, return false if it is unknown
+	 */
+	static bool parse(const std::string& name, kind& type) {
+		const char* names[] = { "minstd", "xoshiro", "pcg", "splitmix" };
+		for (unsigned i = 0; i < 4; i++) {
+			if (name == names[i]) return type = kind(i), true;
+		}
+		return false;
+	}
+
+	void seed(uint64_t v) {
+		switch (type) {
+		case minstd:
+			engine.seed(v);
+			break;
+		case xoshiro:
+			for (uint64_t& x : s) x = mix(v);
+			break;
+		case pcg:
+			s[0] = 0;
+			s[1] = (mix(v) << 1) | 1;
+			step();
+			s[0] += mix(v);
+			step();
+			break;
+		case splitmix:
+			s[0] = v;
+			break;
+		}
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()() {
+		switch (type) {
+		case xoshiro:  return next_xoshiro();
+		case pcg:      { uint64_t hi = next_pcg(); return hi << 32 | next_pcg(); }
+		case splitmix: return mix(s[0]);
+		default:       return std::uniform_int_distribution<uint64_t>()(engine);
+		}
+	}
+
+	/**
+	 * a uniform integer in [0, n), with n > 0
+	 *
+	 * for the fast generators, this is Lemire's multiply-and-shift method, which is unbiased
+	 * and only takes a division in the rare case that the draw falls into the biased range
+	 */
+	uint32_t bounded(uint32_t n) {
+		if (type == minstd) return std::uniform_int_distribution<uint32_t>(0, n - 1)(engine);
+		uint64_t m = uint64_t(next32()) * n;
+		if (uint32_t(m) < n) {
+			uint32_t t = -n % n;
+			while (uint32_t(m) < t) m = uint64_t(next32()) * n;
+		}
+		return m >> 32;
+	}
+
+	/**
+	 * the seed of the i-th stream of a seed, as a counter-based hash of both
+	 * so that the stream of an episode can be set up directly from its index, in any order
+	 */
+	static uint64_t stream(uint64_t seed, uint64_t i) {
+		uint64_t x = seed ^ mix(i);
+		return mix(x);
+	}
+
+	/**
+	 * advance to the next independent stream, i.e., jump over 2^128 (xoshiro) or 2^48 (pcg, splitmix) draws
+	 * minstd has no jump, and is reseeded from its own output instead, which is not guaranteed to be independent
+	 */
+	void jump() {
+		switch (type) {
+		case xoshiro: {
+			static const uint64_t poly[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+			uint64_t t[4] = { 0, 0, 0, 0 };
+			for (uint64_t p : poly) {
+				for (unsigned b = 0; b < 64; b++) {
+					if (p & (1ull << b)) for (unsigned i = 0; i < 4; i++) t[i] ^= s[i];
+					next_xoshiro();
+				}
+			}
+			std::copy(t, t + 4, s);
+			break;
+		}
+		case pcg:
+			advance(1ull << 48);
+			break;
+		case splitmix:
+			s[0] += gamma << 48;
+			break;
+		default:
+			engine.seed(engine());
+			break;
+		}
+	}
+
+private:
+	static constexpr uint64_t gamma = 0x9e3779b97f4a7c15ull;
+	static constexpr uint64_t multiplier = 6364136223846793005ull;
+
+	/**
+	 * the splitmix64 step, which is also used for seeding the other generators
+	 */
+	static uint64_t mix(uint64_t& x) {
+		uint64_t z = (x += gamma);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t next_xoshiro() {
+		uint64_t res = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return res;
+	}
+	/**
+	 * advance the LCG of pcg by delta steps in O(log delta), by squaring its multiplier and increment
+	 */
+	void advance(uint64_t delta) {
+		uint64_t mul = multiplier, inc = s[1], acc_mul = 1, acc_inc = 0;
+		for (; delta; delta >>= 1) {
+			if (delta & 1) acc_mul *= mul, acc_inc = acc_inc * mul + inc;
+			inc = (mul + 1) * inc;
+			mul *= mul;
+		}
+		s[0] = acc_mul * s[0] + acc_inc;
+	}
+	void step() {
+		s[0] = s[0] * multiplier + s[1];
+	}
+	uint32_t next_pcg() {
+		uint64_t x = s[0];
+		step();
+		uint32_t xs = ((x >> 18) ^ x) >> 27, rot = x >> 59;
+		return (xs >> rot) | (xs << ((-rot) & 31));
+	}
+	uint32_t next32() {
+		switch (type) {
+		case pcg: return next_pcg();
+		case xoshiro: return next_xoshiro() >> 32;
+		default: return mix(s[0]) >> 32;
+		}
+	}
+
+private:
+	kind type;
+	uint64_t s[4];
+	std::default_random_engine engine;
+};
@@ -0,0 +1,85 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * recorder.h: Streaming writer and reader of binary episode logs
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "episode.h"
+
+/**
+ * binary episode log, appended episode by episode as they are closed
+ *
+ * the file starts with the magic "2584LOG1", followed by the binary records of episodes (see episode::write),
+ * where the time of moves is kept in ticks of 100 nanoseconds
+ * records are buffered and written when the buffer is full, or when flush is called
+ * with sync, each write is also committed to the disk by fsync
+ */
+class recorder {
+public:
+	recorder(const std::string& path, bool sync = false, size_t buffer = 1 << 20) : sync(sync), limit(buffer) {
+		fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) std::exit(-1);
+		data.reserve(limit + (limit >> 2));
+		data.assign(magic(), 8);
+	}
+	recorder(const recorder&) = delete;
+	recorder& operator =(const recorder&) = delete;
+	~recorder() {
+		flush();
+		::close(fd);
+	}
+
+	void append(const episode& ep) {
+		ep.write(data);
+		if (data.size() >= limit) flush();
+	}
+
+	void flush() {
+		for (size_t done = 0; done < data.size(); ) {
+			ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+			if (n < 0) std::exit(-1);
+			done += n;
+		}
+		data.clear();
+		if (sync) ::fsync(fd);
+	}
+
+	/**
+	 * stream the episodes in a binary log to the text format of statistic, i.e., one episode per line
+	 * return the number of episodes converted, or -1 if the file is not a binary log
+	 */
+	static long convert(const std::string& path, std::ostream& out) {
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		char head[8];
+		if (!in.read(head, 8) || std::memcmp(head, magic(), 8) != 0) return -1;
+		long count = 0;
+		std::string buf;
+		episode ep;
+		for (unsigned char size[4]; in.read(reinterpret_cast<char*>(size), 4); count++) {
+			uint32_t len = size[0] | size[1] << 8 | size[2] << 16 | uint32_t(size[3]) << 24;
+			buf.resize(len);
+			if (!in.read(&buf[0], len)) break;
+			if (!ep.read(reinterpret_cast<const unsigned char*>(buf.data()), len)) break;
+			out << ep << std::endl;
+		}
+		return count;
+	}
+
+private:
+	static const char* magic() { return "2584LOG1"; }
+
+	int fd;
+	bool sync;
+	size_t limit;
+	std::string data;
+};
@@ -0,0 +1,128 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * runner.h: Deterministic parallel runner of episodes
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <map>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "agent.h"
+#include "episode.h"
+#include "statistic.h"
+#include "recorder.h"
+#include "driver.h"
+
+/**
+ * play the remaining episodes of a statistic on several threads
+ *
+ * before episode i is played, both agents are reseeded with i, so that the random agents
+ * use the i-th stream of their seeds, and the episode does not depend on which thread plays it
+ * the finished episodes are merged into the statistic (and the log) strictly in the order of their indices,
+ * so the records and the block reports are the same for any number of threads, except for the timing fields
+ *
+ * each thread has its own agents constructed from the same arguments, without loading nor saving the network,
+ * instead, the agents of the other threads share the network of the given player, which is read-only here,
+ * since the episodes are played without learning (learning depends on the order of episodes)
+ */
+class runner {
+public:
+	runner(const std::string& play_type, const std::string& play_args, const std::string& evil_args, unsigned threads)
+		: play_type(play_type), evil_args(evil_args), threads(std::max(threads, 1u)) {
+		std::stringstream ss(play_args);
+		for (std::string pair; ss >> pair; ) {
+			if (pair.find("save=") != 0 && pair.find("load=") != 0 && pair.find("init") != 0) this->play_args += pair + " ";
+		}
+	}
+
+	/**
+	 * play with the given agents on this thread, and with the copies of them on the other threads
+	 */
+	void run(statistic& stat, weight_agent& play, rndenv& evil, recorder* logger = nullptr) {
+		this->stat = &stat;
+		this->logger = logger;
+		begin = merged = stat.played();
+		end = begin + stat.remaining();
+		window = threads * 64;
+
+		std::vector<std::thread> workers;
+		for (unsigned i = 1; i < threads; i++) {
+			workers.emplace_back([this, &play]() {
+				std::unique_ptr<weight_agent> copy(create(play_type, play_args));
+				copy->share(play);
+				rndenv evil(evil_args);
+				dispatch(*copy, evil);
+			});
+		}
+		dispatch(play, evil);
+		for (std::thread& worker : workers) worker.join();
+	}
+
+	static weight_agent* create(const std::string& type, const std::string& args) {
+		if (type == "mcts") return new mcts_agent(args);
+		return new weight_agent(args);
+	}
+
+private:
+	/**
+	 * take the next episode index, play it, and hand it over for merging
+	 * an index is taken only if it is within the window of unmerged episodes, which bounds the pending ones
+	 */
+	template<class player>
+	void work(player& play, rndenv& evil) {
+		driver<player, rndenv> drive(play, evil);
+		for (size_t i; (i = take()) < end; ) {
+			play.reseed(i);
+			evil.reseed(i);
+			drive.open_episode();
+
+			episode game;
+			game.open_episode(drive.flag());
+			symbol win = drive.play_episode(game);
+			game.close_episode(win);
+			drive.close_episode(win);
+			merge(i, std::move(game));
+		}
+	}
+	void dispatch(weight_agent& play, rndenv& evil) {
+		if (play_type == "mcts") work(static_cast<mcts_agent&>(play), evil);
+		else work(play, evil);
+	}
+
+	size_t take() {
+		std::unique_lock<std::mutex> lock(mutex);
+		ready.wait(lock, [this]() { return begin < merged + window || begin >= end; });
+		return begin < end ? begin++ : end;
+	}
+
+	/**
+	 * keep a finished episode, and merge all the consecutive finished ones into the statistic
+	 */
+	void merge(size_t i, episode&& game) {
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.emplace(i, std::move(game));
+		for (auto it = pending.begin(); it != pending.end() && it->first == merged; it = pending.erase(it), merged++) {
+			stat->append(std::move(it->second));
+			if (logger) logger->append(stat->back());
+		}
+		ready.notify_all();
+	}
+
+private:
+	std::string play_type, play_args, evil_args;
+	unsigned threads;
+	statistic* stat;
+	recorder* logger;
+	size_t begin, end, merged, window;
+	std::map<size_t, episode> pending;
+	std::mutex mutex;
+	std::condition_variable ready;
+};
@@ -0,0 +1,101 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * schedule.h: Learning rate schedules for training
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * a schedule of the scale of the learning rate, which advances by a unit of training at a time,
+ * where a unit is an episode, a block (reported by the statistic), or an evaluation (of the trainer)
+ *
+ * after t units, the scale is
+ * constant: 1
+ * step: decay ^ floor(t / period)
+ * exp: decay ^ (t / period)
+ * invsqrt: 1 / sqrt(1 + t / period)
+ * plateau: multiplied by decay once the average score of a unit has not exceeded the best one for 'patience' units
+ *
+ * the scale is computed from t directly instead of being multiplied per unit, so it does not drift over millions of units
+ */
+class rate_schedule {
+public:
+	enum kind { constant, step, exp, invsqrt, plateau };
+	enum unit { episode, block, eval };
+
+	rate_schedule(kind type = constant, unit per = episode, double period = 1, double decay = 0.5, unsigned patience = 1)
+		: type(type), per(per), period(period), decay(decay), patience(patience), t(0), stale(0), best(0), factor(1) {}
+
+	/**
+	 * parse the name of a schedule, return false if it is unknown
+	 */
+	static bool parse(const std::string& name, kind& type) {
+		const char* names[] = { "constant", "step", "exp", "invsqrt", "plateau" };
+		for (unsigned i = 0; i < 5; i++) {
+			if (name == names[i]) return type = kind(i), true;
+		}
+		return false;
+	}
+	/**
+	 * parse the name of a unit, return false if it is unknown
+	 */
+	static bool parse(const std::string& name, unit& per) {
+		const char* names[] = { "episode", "block", "eval" };
+		for (unsigned i = 0; i < 3; i++) {
+			if (name == names[i]) return per = unit(i), true;
+		}
+		return false;
+	}
+
+	unit granularity() const { return per; }
+	double scale() const { return factor; }
+
+	/**
+	 * advance by one unit, with the average score of the unit (only used by plateau)
+	 * return the new scale
+	 */
+	double advance(double average = 0) {
+		double x = double(++t) / period;
+		switch (type) {
+		case step:
+			factor = std::pow(decay, std::floor(x));
+			break;
+		case exp:
+			factor = std::pow(decay, x);
+			break;
+		case invsqrt:
+			factor = 1 / std::sqrt(1 + x);
+			break;
+		case plateau:
+			if (t == 1 || average > best) {
+				best = average;
+				stale = 0;
+			} else if (++stale >= patience) {
+				factor *= decay;
+				stale = 0;
+			}
+			break;
+		default:
+			break;
+		}
+		return factor;
+	}
+
+private:
+	kind type;
+	unit per;
+	double period;
+	double decay;
+	unsigned patience;
+	size_t t;
+	unsigned stale;
+	double best;
+	double factor;
+};
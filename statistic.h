@@ -8,7 +8,8 @@
  */
 
 #pragma once
-#include <list>
+#include <vector>
+#include <thread>
 #include <algorithm>
 #include <iostream>
 #include <sstream>
@@ -16,6 +17,11 @@
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
+#include "histogram.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 class statistic {
 public:
@@ -24,13 +30,15 @@ public:
 	 * the block size of statistic
 	 * the limit of saving records
 	 *
-	 * note that total >= limit >= block
+	 * note that total >= limit, while the statistic of blocks does not rely on the saved records
 	 */
 	statistic(size_t total, size_t block = 0, size_t limit = 0)
 		: total(total),
 		  block(block ? block : total),
 		  limit(limit ? limit : total),
-		  count(0) {}
+		  count(0),
+		  head(0),
+		  average(0) {}
 
 public:
 	/**
@@ -38,6 +46,7 @@ public:
 	 *
 	 * the format would be
 	 * 1000   avg = 273901, max = 382324, ops = 241563 (170543|896715)
+	 *        p50 = 4.1|0.6, p99 = 9.8|1.3, p999 = 21.5|4.0 (us, player|environment)
 	 *        512     100%   (0.3%)
 	 *        1024    99.7%  (0.2%)
 	 *        2048    99.5%  (1.1%)
@@ -52,21 +61,40 @@ public:
 	 *  'ops = 241563 (170543|896715)': the average speed is 241563
 	 *                                  the average speed of player is 170543
 	 *                                  the average speed of environment is 896715
+	 *  'p99 = 9.8|1.3': 99% of the moves took at most 9.8 us by player, and 1.3 us by environment
 	 *  '93.7%': 93.7% (937 games) reached 8192-tiles (a.k.a. win rate of 8192-tile)
 	 *  '22.4%': 22.4% (224 games) terminated with 8192-tiles (the largest)
 	 */
 	void show(bool tstat = true) const {
-		size_t blk = std::min(data.size(), block);
-		size_t stat[64] = { 0 };
-		size_t sop = 0, pop = 0, eop = 0;
-		time_t sdu = 0, pdu = 0, edu = 0;
-		board::reward sum = 0, max = 0;
-		auto it = data.end();
-		for (size_t i = 0; i < blk; i++) {
-			auto& ep = *(--it);
+		show(recent, tstat);
+	}
+
+	/**
+	 * running accumulators of a set of episodes, updated once per closed episode
+	 * the latency of moves is recorded into the histograms of sliding and placing by the episodes themselves
+	 */
+	struct accumulator {
+		size_t n, sop, pop, eop;
+		time_t sdu, pdu, edu;
+		long long sum;
+		board::reward max;
+		size_t tile[64];
+		histogram lat[2];
+
+		accumulator() { clear(); }
+		void clear() {
+			n = sop = pop = eop = 0;
+			sdu = pdu = edu = 0;
+			sum = max = 0;
+			std::fill(std::begin(tile), std::end(tile), 0);
+			lat[0].clear();
+			lat[1].clear();
+		}
+		void add(const episode& ep) {
+			n++;
 			sum += ep.score();
 			max = std::max(ep.score(), max);
-			stat[*std::max_element(&(ep.state()(0)), &(ep.state()(16)))]++;
+			tile[*std::max_element(&(ep.state()(0)), &(ep.state()(16)))]++;
 			sop += ep.step();
 			pop += ep.step(action::slide::type);
 			eop += ep.step(action::place::type);
@@ -74,6 +102,15 @@ public:
 			pdu += ep.time(action::slide::type);
 			edu += ep.time(action::place::type);
 		}
+	};
+
+	void show(const accumulator& acc, bool tstat = true) const {
+		size_t blk = acc.n;
+		const size_t* stat = acc.tile;
+		size_t sop = acc.sop, pop = acc.pop, eop = acc.eop;
+		time_t sdu = acc.sdu, pdu = acc.pdu, edu = acc.edu;
+		long long sum = acc.sum;
+		board::reward max = acc.max;
 
 		std::ios ff(nullptr);
 		ff.copyfmt(std::cout);
@@ -81,16 +118,26 @@ public:
 		std::cout << count << "\t";
 		std::cout << "avg = " << (sum / blk) << ", ";
 		std::cout << "max = " << (max) << ", ";
-		std::cout << "ops = " << (sop * 1000.0 / sdu);
-		std::cout <<     " (" << (pop * 1000.0 / pdu);
-		std::cout <<      "|" << (eop * 1000.0 / edu) << ")";
+		std::cout << "ops = " << (sop * 1e9 / sdu);
+		std::cout <<     " (" << (pop * 1e9 / pdu);
+		std::cout <<      "|" << (eop * 1e9 / edu) << ")";
 		std::cout << std::endl;
+		if (acc.lat[0].total() && acc.lat[1].total()) {
+			std::cout << std::setprecision(1) << "\t";
+			const char* name[] = { "p50", "p99", "p999" };
+			const double q[] = { 0.5, 0.99, 0.999 };
+			for (unsigned i = 0; i < 3; i++) {
+				std::cout << (i ? ", " : "") << name[i] << " = ";
+				std::cout << (acc.lat[0].percentile(q[i]) / 1000.0) << "|" << (acc.lat[1].percentile(q[i]) / 1000.0);
+			}
+			std::cout << " (us, player|environment)" << std::endl;
+		}
 		std::cout.copyfmt(ff);
 
 		if (!tstat) return;
 		for (size_t t = 0, c = 0; c < blk; c += stat[t++]) {
 			if (stat[t] == 0) continue;
-			unsigned accu = std::accumulate(std::begin(stat) + t, std::end(stat), 0);
+			unsigned accu = std::accumulate(stat + t, stat + 64, 0);
 			std::cout << "\t" << board::fib(t); // type
 			std::cout << "\t" << (accu * 100.0 / blk) << "%"; // win rate
 			std::cout << "\t" "(" << (stat[t] * 100.0 / blk) << "%" ")"; // percentage of ending
@@ -99,58 +146,234 @@ public:
 		std::cout << std::endl;
 	}
 
+	/**
+	 * show the statistic of all the episodes, including the loaded ones
+	 */
 	void summary() const {
-		auto block_temp = block;
-		const_cast<statistic&>(*this).block = data.size();
-		show();
-		const_cast<statistic&>(*this).block = block_temp;
+		show(all());
+		size_t bytes = 0, moves = 0;
+		for (const episode& ep : data) {
+			bytes += ep.ep_moves.packed();
+			moves += ep.ep_moves.size();
+		}
+		episode::memory(bytes, moves);
+	}
+
+	/**
+	 * export the latency histograms of all the episodes, in nanoseconds, e.g.,
+	 * # player
+	 * 768	799	12	0.0012
+	 * ...
+	 * # environment
+	 * 160	167	24	0.0024
+	 * ...
+	 * where each line is the lowest and highest value of a bucket, its count, and the cumulative percentage
+	 */
+	void latency(std::ostream& out) const {
+		accumulator acc(all());
+		out << "# player" << std::endl << acc.lat[0];
+		out << "# environment" << std::endl << acc.lat[1];
 	}
 
 	bool is_finished() const {
 		return count >= total;
 	}
 
-	void open_episode(const std::string& flag = "") {
-		if (count++ >= limit) data.pop_front();
-		data.emplace_back();
-		data.back().open_episode(flag);
+	size_t size() const {
+		return data.size();
+	}
+
+	/**
+	 * the number of episodes so far (including the loaded ones), i.e., the index of the next episode
+	 */
+	size_t played() const {
+		return count;
+	}
+	size_t remaining() const {
+		return total > count ? total - count : 0;
+	}
+
+	/**
+	 * whether the last closed episode completes a block, and the average score of the last completed block,
+	 * which are for adjusting the training by the block reports (e.g., the learning rate schedule)
+	 */
+	bool is_block_end() const {
+		return block && count && count % block == 0;
+	}
+	double block_average() const {
+		return average;
+	}
+
+	/**
+	 * the records are kept in a circular buffer of 'limit' slots,
+	 * once it is full, the slot of the oldest record is reused (including its storage of moves)
+	 */
+	void open_episode(symbol flag = "") {
+		next();
+		back().open_episode(flag);
+		back().attach(recent.lat);
+	}
+
+	void close_episode(symbol flag = "") {
+		back().close_episode(flag);
+		account(back());
 	}
 
-	void close_episode(const std::string& flag = "") {
-		data.back().close_episode(flag);
-		if (count % block == 0) show();
+	/**
+	 * append an episode which is played elsewhere (e.g., by another thread), as if it is opened and closed here
+	 */
+	void append(episode&& ep) {
+		next() = std::move(ep);
+		back().latency(recent.lat);
+		account(back());
 	}
 
 	episode& at(size_t i) {
-		auto it = data.begin();
-		while (i--) it++;
-		return *it;
+		return data[(head + i) % data.size()];
+	}
+	const episode& at(size_t i) const {
+		return data[(head + i) % data.size()];
 	}
 	episode& front() {
-		return data.front();
+		return at(0);
 	}
 	episode& back() {
-		return data.back();
+		return at(data.size() - 1);
 	}
 
 	friend std::ostream& operator <<(std::ostream& out, const statistic& stat) {
-		for (const episode& rec : stat.data) out << rec << std::endl;
+		for (size_t i = 0; i < stat.data.size(); i++) out << stat.at(i) << std::endl;
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, statistic& stat) {
+		std::rotate(stat.data.begin(), stat.data.begin() + stat.head, stat.data.end());
+		stat.head = 0;
 		for (std::string line; std::getline(in, line) && line.size(); ) {
 			stat.data.emplace_back();
 			std::stringstream(line) >> stat.data.back();
+			stat.overall.add(stat.data.back());
 		}
 		stat.total = std::max(stat.total, stat.data.size());
 		stat.count = stat.data.size();
 		return in;
 	}
 
+	/**
+	 * load the records from a file, with the same result as operator >>
+	 * the latency of the loaded moves is not recorded, since their text times are only whole milliseconds
+	 * the file is memory-mapped and split into line-aligned chunks, which are parsed in parallel by episode::parse
+	 * with check, the episodes are also validated, and the violations are reported to std::cerr
+	 * return the number of invalid episodes, or -1 if the file cannot be opened
+	 */
+	long load(const std::string& path, unsigned threads = 1, bool check = false) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return -1;
+		struct stat st;
+		size_t size = (::fstat(fd, &st) == 0) ? st.st_size : 0;
+		void* map = size ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		::close(fd);
+		if (map == MAP_FAILED) return size ? -1 : 0;
+		::madvise(map, size, MADV_SEQUENTIAL);
+
+		struct part {
+			const char* begin;
+			const char* end;
+			std::vector<episode> data;
+			std::vector<std::pair<size_t, std::string>> errors;
+			bool stop;
+			void parse(bool check) {
+				const char* p = begin;
+				for (std::string error; p < end && *p != '\n'; error.clear()) {
+					data.emplace_back();
+					p = data.back().parse(p, end, check ? &error : nullptr) + 1;
+					if (error.size()) errors.emplace_back(data.size() - 1, error);
+				}
+				stop = p < end; // an empty line terminates the records
+			}
+		};
+		const char* text = static_cast<const char*>(map);
+		std::vector<part> parts(std::max(threads, 1u));
+		for (size_t i = 0; i < parts.size(); i++) {
+			const char* begin = i ? parts[i - 1].end : text;
+			const char* end = text + size * (i + 1) / parts.size();
+			while (end < text + size && end > begin && end[-1] != '\n') end++;
+			parts[i].begin = begin;
+			parts[i].end = std::max(begin, end);
+		}
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < parts.size(); i++) workers.emplace_back(&part::parse, &parts[i], check);
+		parts[0].parse(check);
+		for (std::thread& worker : workers) worker.join();
+		::munmap(map, size);
+
+		std::rotate(data.begin(), data.begin() + head, data.end());
+		head = 0;
+		long invalid = 0;
+		size_t line = 0;
+		for (part& part : parts) {
+			for (auto& error : part.errors) {
+				std::cerr << path << ":" << (line + error.first + 1) << ": " << error.second << std::endl;
+				invalid++;
+			}
+			line += part.data.size();
+			for (episode& ep : part.data) {
+				overall.add(ep);
+				data.emplace_back(std::move(ep));
+			}
+			if (part.stop) break;
+		}
+		total = std::max(total, data.size());
+		count = data.size();
+		return invalid;
+	}
+
 private:
+	/**
+	 * take the slot of the next episode, which is a new one or the oldest one
+	 */
+	episode& next() {
+		if (count++ >= limit && data.size()) {
+			data[head].clear();
+			head = (head + 1) % data.size();
+		} else {
+			data.emplace_back();
+		}
+		return back();
+	}
+	/**
+	 * add a closed episode to the statistic, and show the block if it is completed
+	 */
+	void account(const episode& ep) {
+		recent.add(ep);
+		overall.add(ep);
+		if (count % block == 0) {
+			average = double(recent.sum) / recent.n;
+			show(recent);
+			overall.lat[0] += recent.lat[0];
+			overall.lat[1] += recent.lat[1];
+			recent.clear();
+		}
+	}
+
+	/**
+	 * the overall accumulator, with the latency of the unfinished block, which is not merged yet
+	 */
+	accumulator all() const {
+		accumulator acc(overall);
+		if (block && count % block) {
+			acc.lat[0] += recent.lat[0];
+			acc.lat[1] += recent.lat[1];
+		}
+		return acc;
+	}
+
 	size_t total;
 	size_t block;
 	size_t limit;
 	size_t count;
-	std::list<episode> data;
+	size_t head;
+	std::vector<episode> data;
+	accumulator recent;
+	accumulator overall;
+	double average; // the average score of the last completed block
 };
@@ -0,0 +1,54 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * symbol.h: Interned strings for names and tags
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <unordered_set>
+#include <mutex>
+#include <iostream>
+
+/**
+ * a handle of an interned string, which is as small as a pointer and compared by identity
+ *
+ * a string is interned once when a symbol is made from it, and the interned strings live until the program exits,
+ * so copying a symbol or rendering it to text takes no allocation nor lookup
+ * interning is thread-safe, while the other operations do not need any lock
+ */
+class symbol {
+public:
+	symbol() : str(none()) {}
+	symbol(const std::string& s) : str(intern(s)) {}
+	symbol(const char* s) : str(intern(s)) {}
+	symbol(const symbol& s) = default;
+	symbol& operator =(const symbol& s) = default;
+
+	operator const std::string&() const { return *str; }
+	const std::string& name() const { return *str; }
+
+	bool operator ==(const symbol& s) const { return str == s.str; }
+	bool operator !=(const symbol& s) const { return str != s.str; }
+
+	friend std::ostream& operator <<(std::ostream& out, const symbol& s) {
+		return out << *s.str;
+	}
+
+private:
+	static const std::string* none() {
+		static const std::string* str = intern("N/A");
+		return str;
+	}
+	static const std::string* intern(const std::string& s) {
+		static std::unordered_set<std::string> table;
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock(mutex);
+		return &*table.insert(s).first;
+	}
+
+	const std::string* str;
+};
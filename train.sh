@@ -1,8 +1,7 @@
 #!/bin/bash
 
 ./2584 --total=0 --play="init save=weights.bin"
-for i in {1..100}; do
-	./2584 --total=200000 --block=1000 --limit=1000 --play="load=weights.bin save=weights.bin alpha=0.0025" | tee -a train.log
-	./2584 --total=1000 --play="load=weights.bin alpha=0" --save="stat.txt"
-	tar zcvf weights.$(date +%Y%m%d-%H%M%S).tar.gz weights.bin train.log stat.txt
-done
+# 100 rounds of training 200000 games and evaluating 1000 games (saved to stat.txt), with a snapshot weights.bin.r<round> per round
+# the lines of evaluations in train.log start with "eval", e.g., grep -v "^eval" train.log for the training only
+./2584 --rounds=100 --total=200000 --block=1000 --limit=1000 --eval=1000 --checkpoint=1 --save="stat.txt" --play="load=weights.bin save=weights.bin alpha=0.0025" | tee -a train.log
+tar zcvf weights.$(date +%Y%m%d-%H%M%S).tar.gz weights.bin weights.bin.r* train.log stat.txt
@@ -0,0 +1,73 @@
+/**
+ * Framework for 2048 & 2048-like Games (C++ 11)
+ * trainer.h: Training schedule in a single process
+ *
+ * Author: Theory of Computer Games (TCG 2021)
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include "agent.h"
+#include "statistic.h"
+#include "driver.h"
+
+/**
+ * a training schedule with the network kept in memory, as the loop of train.sh in a single process
+ *
+ * each round trains 'total' episodes (reported every 'block' episodes as usual),
+ * then evaluates 'eval' episodes without learning, whose records are saved to 'save' (e.g., stat.txt),
+ * and whose report is printed with every line prefixed by "eval\t", so it is told apart from the training report,
+ * and every 'checkpoint' rounds, the network is saved in background to the path of 'save' of the player
+ * followed by the round (e.g., "weights.bin.r10"), so a snapshot is kept per checkpoint
+ * after each evaluation, the player is notified with 'eval=avg', where avg is the average score of the evaluation,
+ * which drives the learning rate schedule of the player if it is per evaluation, e.g., decaying alpha by 0.9 per round
+ * is "schedule=step per=eval decay=0.9" (see weight_agent::init_schedule)
+ *
+ * the environment of training goes on across rounds, while each evaluation starts a new environment,
+ * so the evaluations of different rounds play against the same sequence of tiles
+ */
+class trainer {
+public:
+	struct schedule {
+		size_t rounds, total, block, limit, eval, checkpoint;
+		std::string save;
+	};
+
+	trainer(const schedule& plan) : plan(plan) {}
+
+	template<class player>
+	void run(player& play, const std::string& evil_args) {
+		rndenv evil(evil_args);
+		for (size_t round = 1; round <= plan.rounds; round++) {
+			statistic train(plan.total, plan.block, plan.limit);
+			play_episodes(train, play, evil);
+
+			float alpha = play.learning_rate();
+			play.learning_rate(0);
+			std::stringstream report;
+			std::streambuf* out = std::cout.rdbuf(report.rdbuf());
+			std::cout << "round " << round << " (alpha = " << alpha << ")" << std::endl;
+			rndenv judge(evil_args);
+			statistic test(plan.eval);
+			play_episodes(test, play, judge);
+			std::cout.rdbuf(out);
+			for (std::string line; std::getline(report, line); ) std::cout << (line.size() ? "eval\t" : "") << line << std::endl;
+			play.learning_rate(alpha);
+			if (plan.eval) play.notify("eval=" + std::to_string(test.block_average()));
+
+			if (plan.save.size()) {
+				std::ofstream out(plan.save, std::ios::out | std::ios::trunc);
+				out << test;
+			}
+			if (plan.checkpoint && round % plan.checkpoint == 0) play.checkpoint(".r" + std::to_string(round), true);
+		}
+	}
+
+private:
+	schedule plan;
+};
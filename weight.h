@@ -12,27 +12,48 @@
 #include <vector>
 #include <utility>
 
+/**
+ * a table owns its values, or is a view of the values of another table (see view),
+ * in which case the other table must outlive it, and the values should only be read
+ * copying a table (either kind) always makes a table owning a copy of the values
+ */
 class weight {
 public:
 	typedef float type;
 
 public:
-	weight() {}
-	weight(size_t len) : value(len) {}
-	weight(weight&& f) : value(std::move(f.value)) {}
-	weight(const weight& f) = default;
+	weight() : data(nullptr), len(0) {}
+	weight(size_t len) : value(len), data(value.data()), len(len) {}
+	weight(weight&& f) noexcept : value(std::move(f.value)), data(f.data), len(f.len) {}
+	weight(const weight& f) : value(f.data, f.data + f.len), data(value.data()), len(f.len) {}
+
+	weight& operator =(const weight& f) {
+		if (this != &f) {
+			value.assign(f.data, f.data + f.len);
+			data = value.data();
+			len = f.len;
+		}
+		return *this;
+	}
+	type& operator[] (size_t i) { return data[i]; }
+	const type& operator[] (size_t i) const { return data[i]; }
+	size_t size() const { return len; }
 
-	weight& operator =(const weight& f) = default;
-	type& operator[] (size_t i) { return value[i]; }
-	const type& operator[] (size_t i) const { return value[i]; }
-	size_t size() const { return value.size(); }
+	/**
+	 * a table sharing the values of the given table, without copying them
+	 */
+	static weight view(const weight& f) {
+		weight w;
+		w.data = f.data;
+		w.len = f.len;
+		return w;
+	}
 
 public:
 	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
-		auto& value = w.value;
-		uint64_t size = value.size();
+		uint64_t size = w.len;
 		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
-		out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * size);
+		out.write(reinterpret_cast<const char*>(w.data), sizeof(type) * size);
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, weight& w) {
@@ -41,9 +62,13 @@ public:
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
 		value.resize(size);
 		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * size);
+		w.data = value.data();
+		w.len = size;
 		return in;
 	}
 
 protected:
 	std::vector<type> value;
+	type* data;
+	size_t len;
 };